@@ -0,0 +1,765 @@
+//
+//  Benchmarks.cpp
+//  ModelViewer
+//
+//  Times the hot paths of the core library and counts what they allocate.
+//  Usage: ModelViewerBenchmarks [name filter]
+//  Exits with 1 if a steady-state frame allocated.
+//
+
+#include "Interfaces.hpp"
+#include "BufferArena.hpp"
+#include "FrameProfiler.hpp"
+#include "ObjSurface.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "NormalGenerator.hpp"
+#include "VertexCompression.hpp"
+#include "ParametricEquations.hpp"
+#include "RenderingEngine.Software.hpp"
+#include "SurfaceLoader.hpp"
+#include "SurfaceRegistry.hpp"
+#include "Parallel.hpp"
+#ifdef MODELVIEWER_NULL_GL
+#include "NullGL.hpp"
+#endif
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+// Each benchmark repeats until it has run for at least this long.
+static const double MinBenchmarkSeconds = 0.25;
+
+static const ivec2 ScreenSize(320, 480);
+
+struct AllocationCounts {
+    volatile size_t Bytes;
+    volatile size_t Count;
+};
+
+static AllocationCounts s_allocations;
+
+// Every operator new in the process goes through here, so the benchmarks can
+// report what they allocate; mapped files are not counted.
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+    __sync_fetch_and_add(&s_allocations.Bytes, size);
+    __sync_fetch_and_add(&s_allocations.Count, 1);
+    void* memory = malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+// Kept out of line, or GCC pairs the inlined free with new expressions and warns.
+__attribute__((noinline)) void operator delete(void* memory) throw()
+{
+    free(memory);
+}
+
+static double GetSeconds()
+{
+    timeval time;
+    gettimeofday(&time, 0);
+    return time.tv_sec + time.tv_usec * 1e-6;
+}
+
+// Makes the compiler assume state is read and changed here, so inlined work
+// on it can't be hoisted out of the timing loop or thrown away.
+static inline void ClobberState(const void* state)
+{
+    asm volatile("" : : "r"(state) : "memory");
+}
+
+static const char* s_filter;
+
+// Runs benchmark() until MinBenchmarkSeconds have passed and prints the time
+// and allocations per call. Returns nanoseconds per call, or 0 if filtered out.
+template <typename Benchmark>
+static double RunBenchmark(const string& name, Benchmark& benchmark)
+{
+    if (s_filter && name.find(s_filter) == string::npos)
+        return 0;
+    
+    // The first call warms caches and builds anything lazily created
+    benchmark();
+    
+    long long iterations = 1;
+    for (;;) {
+        size_t bytes = s_allocations.Bytes;
+        size_t count = s_allocations.Count;
+        double start = GetSeconds();
+        for (long long i = 0; i < iterations; ++i)
+            benchmark();
+        double elapsed = GetSeconds() - start;
+        if (elapsed >= MinBenchmarkSeconds) {
+            double nanoseconds = elapsed * 1e9 / iterations;
+            printf("%-40s %14.1f ns/op %12.0f B/op %10.1f allocs/op\n", name.c_str(), nanoseconds,
+                   (double) (s_allocations.Bytes - bytes) / iterations,
+                   (double) (s_allocations.Count - count) / iterations);
+            fflush(stdout);
+            return nanoseconds;
+        }
+        long long estimate = elapsed > 0 ? (long long) (iterations * MinBenchmarkSeconds * 1.2 / elapsed) : 0;
+        iterations = min(iterations * 100, max(iterations * 2, estimate));
+    }
+}
+
+static string FormatName(const char* format, int a, int b = 0)
+{
+    char name[64];
+    snprintf(name, sizeof(name), format, a, b);
+    return name;
+}
+
+// A parametric surface at a chosen resolution.
+template <typename Shape>
+struct Tessellated : Shape {
+    Tessellated(float scale, ivec2 divisions, vec2 upperBound) : Shape(scale)
+    {
+        ParametricInterval interval = { divisions, upperBound };
+        this->SetInterval(interval);
+    }
+};
+
+struct LoadObjBenchmark {
+    string Path;
+    void operator()()
+    {
+        delete new ObjSurface(Path);
+    }
+};
+
+struct LoadCachedObjBenchmark {
+    string Path;
+    string CachePath;
+    void operator()()
+    {
+        delete CreateCachedObjSurface(Path, CachePath);
+    }
+};
+
+struct GenerateVerticesBenchmark {
+    const ISurface* Surface;
+    void operator()()
+    {
+        vector<float> vertices;
+        Surface->GenerateVertices(vertices, VertexFlagsNormal);
+    }
+};
+
+struct CompressVerticesBenchmark {
+    const vector<float>* Vertices;
+    void operator()()
+    {
+        vector<CompactVertex> compactVertices;
+        VertexQuantization quantization;
+        CompressVertices(&(*Vertices)[0], Vertices->size() / 6, compactVertices, quantization);
+    }
+};
+
+struct TessellateBenchmark {
+    const ISurface* Surface;
+    void operator()()
+    {
+        vector<float> vertices;
+        vector<unsigned int> indices;
+        Surface->GenerateVertices(vertices, VertexFlagsNormal);
+        Surface->GenerateTriangleIndices(indices);
+    }
+};
+
+struct OptimizeSurfaceBenchmark {
+    void operator()()
+    {
+        delete new OptimizedSurface(new TrefoilKnot(1.8f));
+    }
+};
+
+struct VertexNormalsBenchmark {
+    vector<vec3> Positions;
+    vector<ivec3> Faces;
+    NormalWeighting Weighting;
+    int MaxThreads;
+    void operator()()
+    {
+        vector<vec3> normals;
+        GenerateVertexNormals(Positions, Faces, normals, Weighting, MaxThreads);
+    }
+};
+
+struct SlerpBenchmark {
+    Quaternion Start;
+    Quaternion End;
+    Quaternion Result;
+    float Mu;
+    void operator()()
+    {
+        Mu = Mu < 1 ? Mu + 0.001f : 0;
+        Result = Start.Slerp(Mu, End);
+        ClobberState(this);
+    }
+};
+
+struct ToMatrixBenchmark {
+    Quaternion Orientation;
+    mat3 Result;
+    void operator()()
+    {
+        Result = Orientation.ToMatrix();
+        ClobberState(this);
+    }
+};
+
+struct MatrixMultiplyBenchmark {
+    mat4 A;
+    mat4 B;
+    mat4 Result;
+    void operator()()
+    {
+        Result = A * B;
+        ClobberState(this);
+    }
+};
+
+// Replaces a random surface's block with one of another size, as surfaces
+// come and go; buffers are numbered rather than created.
+struct ArenaChurnBenchmark {
+    BufferArena Arena;
+    vector<ArenaBlock> Blocks;
+    unsigned int NextBuffer;
+    unsigned int Random;
+    size_t NextSize()
+    {
+        Random = Random * 1664525 + 1013904223;
+        return 1024 + (Random >> 8) % (512 * 1024);
+    }
+    void Allocate(ArenaBlock& block)
+    {
+        size_t size = NextSize();
+        if (!Arena.Allocate(size, block)) {
+            Arena.AddPage(++NextBuffer, Arena.GetNewPageSize(size));
+            Arena.Allocate(size, block);
+        }
+    }
+    void operator()()
+    {
+        ArenaBlock& block = Blocks[(Random >> 8) % Blocks.size()];
+        Arena.Free(block);
+        Allocate(block);
+    }
+};
+
+struct RenderFrameBenchmark {
+    IApplicationEngine* Engine;
+    void operator()()
+    {
+        FrameProfiler& profiler = Engine->GetFrameProfiler();
+        profiler.BeginFrame();
+        Engine->UpdateAnimation(1.0f / 60);
+        Engine->Render();
+        profiler.EndFrame();
+    }
+};
+
+// A frame while a finger drags the main surface round, spinning it.
+struct SpinFrameBenchmark {
+    IApplicationEngine* Engine;
+    int Frame;
+    void operator()()
+    {
+        ivec2 center(ScreenSize.x / 2, ScreenSize.y / 2);
+        ivec2 previous(center.x + Frame % 40, center.y);
+        ivec2 next(center.x + ++Frame % 40, center.y);
+        Engine->OnFingerMove(previous, next);
+        Engine->UpdateAnimation(1.0f / 60);
+        Engine->Render();
+    }
+};
+
+// Visuals, all in one viewport, straight through the rendering engine.
+struct RenderVisualsBenchmark {
+    IRenderingEngine* Engine;
+    const vector<Visual>* Visuals;
+    void operator()()
+    {
+        Engine->Render(VisualList(&(*Visuals)[0], Visuals->size()));
+    }
+};
+
+// A frame as the app's frame loop runs it, drawn only if something changed.
+struct OnDemandFrameBenchmark {
+    IApplicationEngine* Engine;
+    void operator()()
+    {
+        FrameProfiler& profiler = Engine->GetFrameProfiler();
+        profiler.BeginFrame();
+        Engine->UpdateAnimation(1.0f / 60);
+        if (!Engine->NeedsRedraw()) {
+            profiler.SkipFrame();
+            return;
+        }
+        Engine->Render();
+        profiler.EndFrame();
+    }
+};
+
+// Times compressing a surface's vertices to the compact format, and reports
+// how far they end up from the float ones.
+static void MeasureVertexCompression(const string& name, const ISurface& surface)
+{
+    vector<float> vertices;
+    surface.GenerateVertices(vertices, VertexFlagsNormal);
+    CompressVerticesBenchmark compress = { &vertices };
+    if (RunBenchmark("CompressVertices " + name, compress) == 0)
+        return;
+    
+    vector<CompactVertex> compactVertices;
+    VertexQuantization quantization;
+    CompressVertices(&vertices[0], surface.GetVertexCount(), compactVertices, quantization);
+    CompressionError error = MeasureCompressionError(&vertices[0], compactVertices, quantization);
+    printf("    %d vertices, %d bytes each instead of %d; position error %.2g max (%.2g of the box diagonal),"
+           " normal error %.4f mean %.4f max degrees\n", surface.GetVertexCount(), (int) sizeof(CompactVertex),
+           (int) sizeof(float) * 6, error.MaxPositionError, error.MaxRelativePositionError,
+           error.MeanNormalErrorDegrees, error.MaxNormalErrorDegrees);
+}
+
+// The app, initialized and with every surface loaded.
+static IApplicationEngine* CreateLoadedApplication(IRenderingEngine* renderingEngine, IResourceManager* resourceManager)
+{
+    IApplicationEngine* applicationEngine = CreateApplicationEngine(renderingEngine, resourceManager);
+    applicationEngine->Initialize(ScreenSize.x, ScreenSize.y);
+    while (applicationEngine->IsLoading()) {
+        applicationEngine->UpdateAnimation(0);
+        usleep(1000);
+    }
+    applicationEngine->GetFrameProfiler().Reset();
+    return applicationEngine;
+}
+
+static void PrintRenderStats(const RenderStats& stats)
+{
+    const GLCallCounts& calls = stats.Calls;
+    printf("    %d draws, %d triangles, %d state calls issued, %d elided\n", stats.DrawCalls, calls.Triangles,
+           stats.StateCallsIssued, stats.StateCallsElided);
+    printf("    GL calls: %d draws, %d buffer binds, %d uniform uploads, %d other state changes, %zu bytes uploaded\n",
+           calls.DrawCalls, calls.BufferBinds, calls.UniformUploads, calls.StateChanges, calls.BytesUploaded);
+    if (stats.DrawCallsSaved > 0 || stats.PixelsSaved > 0) {
+        printf("    Partial redraw: %d draws, %d pixels saved\n", stats.DrawCallsSaved, stats.PixelsSaved);
+    }
+}
+
+// The draws an engine counts itself must be the draws GL saw, which only a
+// traced build can tell.
+static bool CheckDrawCount(const RenderStats& stats)
+{
+    if (stats.DrawCalls != stats.Calls.DrawCalls)
+        printf("    FAILED: %d draws counted, %d issued\n", stats.DrawCalls, stats.Calls.DrawCalls);
+    return stats.DrawCalls == stats.Calls.DrawCalls;
+}
+
+// A frame, once the app has settled, must not allocate: everything it
+// builds reuses the memory of the frame before. Counts what frameCount
+// frames allocate after a benchmark has warmed the app up, and returns
+// false if they allocated anything.
+static bool CheckFrameAllocations(IApplicationEngine* applicationEngine, int frameCount = 100)
+{
+    RenderFrameBenchmark renderFrame = { applicationEngine };
+    size_t bytes = s_allocations.Bytes;
+    size_t count = s_allocations.Count;
+    for (int i = 0; i < frameCount; ++i)
+        renderFrame();
+    count = s_allocations.Count - count;
+    bytes = s_allocations.Bytes - bytes;
+    if (count > 0)
+        printf("    FAILED: %zu allocations, %zu bytes in %d steady-state frames\n", count, bytes, frameCount);
+    return count == 0;
+}
+
+// Where the frames went, phase by phase, as the app's profiler saw them.
+static void PrintFrameProfile(const FrameProfiler& profiler)
+{
+    for (int phase = 0; phase < FramePhaseCount; ++phase) {
+        PhaseStats stats = profiler.GetPhaseStats((FramePhase) phase);
+        if (stats.Count > 0) {
+            printf("    %-12s %10.1f us p50 %10.1f us p99 %10.1f us max\n", stats.Name, stats.Median * 1e6,
+                   stats.P99 * 1e6, stats.Max * 1e6);
+        }
+    }
+    printf("    %d of %d frames over budget\n", profiler.GetOverrunCount(), profiler.GetFrameCount());
+}
+
+// Time from Initialize to the first frame, and until every surface has
+// loaded in the background and been swapped in, drawing frames meanwhile.
+static void MeasureStartup(IResourceManager* resourceManager)
+{
+    if (s_filter && strstr("Startup", s_filter) == 0)
+        return;
+    
+    IRenderingEngine* renderingEngine = new Software::RenderingEngine(ScreenSize.x, ScreenSize.y);
+    IApplicationEngine* applicationEngine = CreateApplicationEngine(renderingEngine, resourceManager);
+    double start = GetSeconds();
+    applicationEngine->Initialize(ScreenSize.x, ScreenSize.y);
+    applicationEngine->Render();
+    double firstFrame = GetSeconds() - start;
+    int frameCount = 1;
+    while (applicationEngine->IsLoading()) {
+        applicationEngine->UpdateAnimation(0);
+        applicationEngine->Render();
+        ++frameCount;
+    }
+    double loaded = GetSeconds() - start;
+    printf("%-40s %14.1f ms to first frame, %.1f ms to load all (%d frames)\n", "Startup", firstFrame * 1e3,
+           loaded * 1e3, frameCount);
+    delete applicationEngine;
+}
+
+// Loads the app's surfaces through the loader's task graph and prints where
+// the time went, per stage and along the critical path.
+static void MeasureLoadPipeline(const char* name, IResourceManager* resourceManager, const string& cacheDirectory,
+                                int maxThreads)
+{
+    if (s_filter && strstr(name, s_filter) == 0)
+        return;
+    
+    string path = resourceManager->GetResourcepath();
+    double start = GetSeconds();
+    SurfaceLoader loader(cacheDirectory);
+    loader.AddObjFile(path + "/Ninja.obj");
+    loader.AddSurface(new Sphere(1.4f));
+    loader.AddSurface(new Torus(1.4f, 0.3f));
+    loader.AddSurface(new TrefoilKnot(1.8f));
+    loader.AddObjFile(path + "/micronapalmv2.obj");
+    loader.AddSurface(new MobiusStrip(1));
+    loader.Start(maxThreads);
+    while (!loader.IsDone()) {
+        ISurface* surface;
+        if (loader.TakeFinished(&surface) != -1)
+            delete surface;
+        else
+            usleep(100);
+    }
+    printf("%-40s %14.1f ms, %d threads\n", name, (GetSeconds() - start) * 1e3, maxThreads);
+    
+    const TaskGraph& graph = loader.GetTaskGraph();
+    vector<StageTiming> stages;
+    graph.GetStageTimings(stages);
+    for (size_t i = 0; i < stages.size(); ++i) {
+        printf("    %-10s %2d tasks %9.2f ms total %9.2f ms longest\n", stages[i].Stage, stages[i].TaskCount,
+               stages[i].TotalSeconds * 1e3, stages[i].MaxSeconds * 1e3);
+    }
+    vector<int> criticalPath;
+    graph.GetCriticalPath(criticalPath);
+    printf("    critical path:");
+    for (size_t i = 0; i < criticalPath.size(); ++i) {
+        const TaskTiming& timing = graph.GetTaskTiming(criticalPath[i]);
+        printf(" %s %d (%.2f-%.2f ms)", timing.Stage, timing.Index, timing.Start * 1e3, timing.End * 1e3);
+    }
+    printf("\n");
+}
+
+// Requests the page of the catalog starting at first and ends the frame.
+// Returns whether the whole page was resident.
+static bool RequestPage(SurfaceRegistry& registry, const vector<int>& catalog, size_t first, size_t pageSize)
+{
+    bool resident = true;
+    size_t end = min(first + pageSize, catalog.size());
+    for (size_t i = first; i < end; ++i)
+        resident = registry.Request(catalog[i]) && resident;
+    registry.Update();
+    return resident;
+}
+
+// Pages through a catalog of far more surfaces than fit the budget, a page
+// of the app's visuals at a time, waiting for each page to load; then again,
+// each page having been evicted since. Last, flicks through pages a frame
+// each and waits for the page it stops at, which shouldn't wait for those
+// passed over.
+static void MeasureSurfaceBrowsing(IResourceManager* resourceManager, size_t budgetBytes)
+{
+    const char* name = "Surface catalog browsing";
+    if (s_filter && strstr(name, s_filter) == 0)
+        return;
+    
+    Software::RenderingEngine renderingEngine(ScreenSize.x, ScreenSize.y, 1);
+    SurfaceRegistry registry(&renderingEngine, resourceManager->GetCachePath(), budgetBytes);
+    Sphere placeholder(1.4f);
+    registry.Initialize(placeholder);
+    string path = resourceManager->GetResourcepath();
+    vector<int> catalog;
+    catalog.push_back(registry.AddObjFile(path + "/Ninja.obj"));
+    catalog.push_back(registry.AddObjFile(path + "/micronapalmv2.obj"));
+    for (int i = 0; i < 190; ++i) {
+        float size = 1 + i * 0.005f;
+        ISurface* surface;
+        switch (i % 4) {
+            case 0: surface = new Sphere(size); break;
+            case 1: surface = new Torus(size, 0.3f); break;
+            case 2: surface = new TrefoilKnot(size); break;
+            default: surface = new MobiusStrip(size); break;
+        }
+        catalog.push_back(registry.AddSurface(surface));
+    }
+    
+    const int pageSize = 6;
+    const int passCount = 2;
+    int pageCount = 0;
+    size_t maxResidentBytes = 0;
+    double start = GetSeconds();
+    for (int pass = 0; pass < passCount; ++pass) {
+        for (size_t first = 0; first < catalog.size(); first += pageSize, ++pageCount) {
+            bool resident;
+            do {
+                resident = RequestPage(registry, catalog, first, pageSize);
+                maxResidentBytes = max(maxResidentBytes, registry.GetStats().ResidentBytes);
+                if (!resident)
+                    usleep(100);
+            } while (!resident);
+        }
+    }
+    double seconds = GetSeconds() - start;
+    
+    SurfaceStats stats = registry.GetStats();
+    printf("%-40s %14.1f ms per page of %d, %d surfaces\n", name, seconds * 1e3 / pageCount, pageSize,
+           stats.SurfaceCount);
+    printf("    %d hits, %d misses, %d loads, %d evictions\n", stats.Hits, stats.Misses, stats.Loads,
+           stats.Evictions);
+    printf("    %d resident, %zu KB of a %zu KB budget, %zu KB at most\n", stats.ResidentCount,
+           stats.ResidentBytes / 1024, stats.BudgetBytes / 1024, maxResidentBytes / 1024);
+    
+    const int flickCount = 8;
+    size_t first = 0;
+    for (int page = 0; page < flickCount; ++page, first += pageSize)
+        RequestPage(registry, catalog, first, pageSize);
+    start = GetSeconds();
+    while (!RequestPage(registry, catalog, first, pageSize))
+        usleep(100);
+    printf("    %.1f ms to show the page after flicking past %d\n", (GetSeconds() - start) * 1e3, flickCount);
+}
+
+int main(int argc, char** argv)
+{
+    s_filter = argc > 1 ? argv[1] : 0;
+    mkdir(BENCHMARK_CACHE_PATH, 0755);
+    IResourceManager* resourceManager = CreateDirectoryResourceManager(BENCHMARK_RESOURCE_PATH, BENCHMARK_CACHE_PATH);
+    string ninjaPath = resourceManager->GetResourcepath() + "/Ninja.obj";
+    printf("%d cores\n", GetCoreCount());
+    int failureCount = 0; // Checks failed, for the exit status
+    
+    MeasureStartup(resourceManager);
+    
+    // Without a usable cache every stage runs; with a warm one OBJ files skip all but parsing
+    string noCache = resourceManager->GetCachePath() + "/Missing";
+    MeasureLoadPipeline("Load pipeline, no cache", resourceManager, noCache, 1);
+    MeasureLoadPipeline("Load pipeline, no cache", resourceManager, noCache, 4);
+    MeasureLoadPipeline("Load pipeline, warm cache", resourceManager, resourceManager->GetCachePath(), 4);
+    MeasureSurfaceBrowsing(resourceManager, 4 << 20);
+    
+    // Surfaces
+    // Every bundled mesh, parsed in its single pass and from the mesh cache
+    const char* meshNames[] = { "Ninja", "micronapalmv2", "capsule" };
+    for (int i = 0; i < 3; ++i) {
+        string meshPath = resourceManager->GetResourcepath() + "/" + meshNames[i] + ".obj";
+        LoadObjBenchmark loadObj = { meshPath };
+        RunBenchmark(string("ObjSurface load ") + meshNames[i], loadObj);
+    
+        LoadCachedObjBenchmark loadCachedObj = { meshPath, resourceManager->GetCachePath() };
+        RunBenchmark(string("Cached ObjSurface load ") + meshNames[i], loadCachedObj);
+    }
+    
+    ObjSurface ninja(ninjaPath);
+    GenerateVerticesBenchmark generateVertices = { &ninja };
+    RunBenchmark("GenerateVertices normals Ninja", generateVertices);
+    
+    // Compact vertex format, against the float one
+    MeasureVertexCompression("Ninja", ninja);
+    MeasureVertexCompression("micronapalmv2", ObjSurface(resourceManager->GetResourcepath() + "/micronapalmv2.obj"));
+    MeasureVertexCompression("Sphere 100x100", Tessellated<Sphere>(1.4f, ivec2(100, 100), vec2(Pi, TwoPi)));
+    MeasureVertexCompression("TrefoilKnot 300x100",
+                             Tessellated<TrefoilKnot>(1.8f, ivec2(300, 100), vec2(TwoPi, TwoPi)));
+    
+    const int divisionCounts[] = { 20, 100, 400 };
+    for (int i = 0; i < 3; ++i) {
+        int divisions = divisionCounts[i];
+        Tessellated<Sphere> sphere(1.4f, ivec2(divisions, divisions), vec2(Pi, TwoPi));
+        TessellateBenchmark tessellateSphere = { &sphere };
+        RunBenchmark(FormatName("Tessellate Sphere %dx%d", divisions, divisions), tessellateSphere);
+    
+        Tessellated<TrefoilKnot> knot(1.8f, ivec2(divisions * 3, divisions), vec2(TwoPi, TwoPi));
+        TessellateBenchmark tessellateKnot = { &knot };
+        RunBenchmark(FormatName("Tessellate TrefoilKnot %dx%d", divisions * 3, divisions), tessellateKnot);
+    }
+    
+    OptimizeSurfaceBenchmark optimizeSurface;
+    RunBenchmark("OptimizedSurface TrefoilKnot", optimizeSurface);
+    
+    // Vertex normals of a knot with ~240k faces
+    Tessellated<TrefoilKnot> knot(1.8f, ivec2(1200, 100), vec2(TwoPi, TwoPi));
+    vector<float> knotVertices;
+    vector<unsigned int> knotIndices;
+    knot.GenerateVertices(knotVertices, 0);
+    knot.GenerateTriangleIndices(knotIndices);
+    VertexNormalsBenchmark vertexNormals;
+    vertexNormals.Positions.assign((vec3*) &knotVertices[0], (vec3*) &knotVertices[0] + knotVertices.size() / 3);
+    vertexNormals.Faces.assign((ivec3*) &knotIndices[0], (ivec3*) &knotIndices[0] + knotIndices.size() / 3);
+    // The serial scatter, then split over more and more threads, which must
+    // give the serial normals up to rounding
+    const char* weightingNames[] = { "area", "angle" };
+    for (int weighting = 0; weighting < 2; ++weighting) {
+        vertexNormals.Weighting = (NormalWeighting) weighting;
+        vector<vec3> serialNormals;
+        GenerateVertexNormals(vertexNormals.Positions, vertexNormals.Faces, serialNormals, vertexNormals.Weighting, 1);
+        for (int threads = 1; threads <= 8; threads *= 2) {
+            vertexNormals.MaxThreads = threads;
+            RunBenchmark(string("Vertex normals ") + weightingNames[weighting] +
+                         FormatName(" weighted, %d threads", threads), vertexNormals);
+            vector<vec3> normals;
+            GenerateVertexNormals(vertexNormals.Positions, vertexNormals.Faces, normals, vertexNormals.Weighting, threads);
+            float maxDifference = 0;
+            for (size_t v = 0; v < normals.size(); ++v)
+                maxDifference = max(maxDifference, (normals[v] - serialNormals[v]).Length());
+            if (maxDifference > 1e-5f) {
+                printf("    FAILED: normals differ from the serial ones by up to %g\n", maxDifference);
+                ++failureCount;
+            }
+        }
+    }
+    
+    // Vertex arena with 64 surfaces of 1-513 KB coming and going
+    ArenaChurnBenchmark arenaChurn;
+    arenaChurn.NextBuffer = 0;
+    arenaChurn.Random = 1;
+    arenaChurn.Blocks.resize(64);
+    for (size_t i = 0; i < arenaChurn.Blocks.size(); ++i)
+        arenaChurn.Allocate(arenaChurn.Blocks[i]);
+    if (RunBenchmark("BufferArena churn", arenaChurn) > 0) {
+        ArenaStats stats = arenaChurn.Arena.GetStats();
+        printf("    %d buffers, %.1f%% used, %d free ranges, largest %zu KB\n", stats.PageCount,
+               stats.BytesUsed * 100.0 / stats.BytesReserved, stats.FreeRangeCount, stats.LargestFreeRange / 1024);
+    }
+    
+    // Math
+    SlerpBenchmark slerp;
+    slerp.Start = Quaternion::CreateFromAxisAngle(vec3(0, 1, 0), 0.3f);
+    slerp.End = Quaternion::CreateFromAxisAngle(vec3(1, 0, 0), 2.0f);
+    slerp.Mu = 0;
+    RunBenchmark("Quaternion::Slerp", slerp);
+    
+    ToMatrixBenchmark toMatrix;
+    toMatrix.Orientation = slerp.End;
+    RunBenchmark("Quaternion::ToMatrix", toMatrix);
+    
+    MatrixMultiplyBenchmark multiply;
+    multiply.A = mat4(toMatrix.Orientation.ToMatrix()) * mat4::Translate(0, 0, -7);
+    multiply.B = mat4::Frustum(-2, 2, -3, 3, 5, 10);
+    RunBenchmark("mat4 multiply", multiply);
+    
+    // Whole frames of the app on the software renderer, by thread count
+    int maxThreads = max(GetCoreCount(), 4);
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        IRenderingEngine* renderingEngine = new Software::RenderingEngine(ScreenSize.x, ScreenSize.y, threads);
+        IApplicationEngine* applicationEngine = CreateLoadedApplication(renderingEngine, resourceManager);
+        RenderFrameBenchmark renderFrame = { applicationEngine };
+        double nanoseconds = RunBenchmark(FormatName("Software frame %dx%d", ScreenSize.x, ScreenSize.y) +
+                                          FormatName(", %d threads", threads), renderFrame);
+        if (nanoseconds > 0) {
+            printf("%-40s %14.1f fps\n", "", 1e9 / nanoseconds);
+            PrintFrameProfile(applicationEngine->GetFrameProfiler());
+            failureCount += !CheckFrameAllocations(applicationEngine);
+        }
+        delete applicationEngine;
+    }
+    
+    // The same with nothing moving, drawing on demand: every frame after the
+    // first is skipped
+    {
+        IRenderingEngine* renderingEngine = new Software::RenderingEngine(ScreenSize.x, ScreenSize.y, 1);
+        IApplicationEngine* applicationEngine = CreateLoadedApplication(renderingEngine, resourceManager);
+        OnDemandFrameBenchmark onDemandFrame = { applicationEngine };
+        if (RunBenchmark(FormatName("Software idle frame %dx%d, on demand", ScreenSize.x, ScreenSize.y),
+                         onDemandFrame) > 0) {
+            const FrameProfiler& profiler = applicationEngine->GetFrameProfiler();
+            printf("    %d frames drawn, %d skipped\n", profiler.GetFrameCount(), profiler.GetSkippedFrameCount());
+        }
+        delete applicationEngine;
+    }
+    
+#ifdef MODELVIEWER_NULL_GL
+    // Whole frames through the OpenGL ES backends over NullGL: the CPU cost of
+    // submitting a frame, and what it submits
+    NullGL::SetRenderbufferSize(ScreenSize.x, ScreenSize.y);
+    const char* glNames[] = { "ES1 frame, NullGL", "ES2 frame, NullGL", "ES2 frame, NullGL, compact vertices" };
+    for (int i = 0; i < 3; ++i) {
+        IRenderingEngine* renderingEngine = i == 0 ? ES1::CreateRenderingEngine() :
+            ES2::CreateRenderingEngine(i == 1 ? VertexFormatFloat : VertexFormatCompact);
+        IApplicationEngine* applicationEngine = CreateLoadedApplication(renderingEngine, resourceManager);
+        RenderFrameBenchmark renderFrame = { applicationEngine };
+        if (RunBenchmark(glNames[i], renderFrame) > 0) {
+            PrintRenderStats(applicationEngine->GetRenderStats());
+            failureCount += !CheckDrawCount(applicationEngine->GetRenderStats());
+            PrintFrameProfile(applicationEngine->GetFrameProfiler());
+            failureCount += !CheckFrameAllocations(applicationEngine);
+        }
+        delete applicationEngine;
+    }
+    
+    // Spinning the main surface: the thumbnails don't change, so partial
+    // redraw leaves them be
+    const char* spinNames[] = { "ES2 spinning frame, NullGL", "ES2 spinning frame, NullGL, partial redraw" };
+    for (int i = 0; i < 2; ++i) {
+        IRenderingEngine* renderingEngine = ES2::CreateRenderingEngine(VertexFormatFloat,
+                                                                       i == 0 ? RedrawModeFull : RedrawModePartial);
+        IApplicationEngine* applicationEngine = CreateLoadedApplication(renderingEngine, resourceManager);
+        applicationEngine->OnFingerDown(ivec2(ScreenSize.x / 2, ScreenSize.y / 2));
+        SpinFrameBenchmark spinFrame = { applicationEngine, 0 };
+        if (RunBenchmark(spinNames[i], spinFrame) > 0) {
+            PrintRenderStats(applicationEngine->GetRenderStats());
+            failureCount += !CheckDrawCount(applicationEngine->GetRenderStats());
+        }
+        delete applicationEngine;
+    }
+    
+    // A growing crowd of one surface: drawn with instanced arrays, batched
+    // through uniform arrays without them, and one by one with compact
+    // vertices, which aren't batched
+    const char* defaultExtensions = NullGL::GetExtensions();
+    const char* instancingNames[] = { "instanced arrays", "uniform batches", "a draw each" };
+    for (int mode = 0; mode < 3; ++mode) {
+        NullGL::SetExtensions(mode == 1 ? "GL_OES_element_index_uint" : defaultExtensions);
+        IRenderingEngine* renderingEngine = ES2::CreateRenderingEngine(mode == 2 ? VertexFormatCompact :
+                                                                       VertexFormatFloat);
+        Sphere sphere(0.1);
+        vector<ISurface*> surfaces(1, &sphere);
+        renderingEngine->Initialize(surfaces);
+        for (int count = 1; count <= 4096; count *= 8) {
+            vector<Visual> visuals(count);
+            for (int i = 0; i < count; ++i) {
+                visuals[i].Color = vec3(1, 0.5f, i % 2);
+                visuals[i].LowerLeft = ivec2(0, 0);
+                visuals[i].ViewportSize = ScreenSize;
+                visuals[i].Position = vec3(i % 64 * 0.05f - 1.6f, i / 64 * 0.05f - 1.6f, 0);
+            }
+            RenderVisualsBenchmark renderVisuals = { renderingEngine, &visuals };
+            double nanoseconds = RunBenchmark(FormatName("ES2 %d instances, NullGL, ", count) + instancingNames[mode],
+                                              renderVisuals);
+            if (nanoseconds > 0) {
+                RenderStats stats = renderingEngine->GetRenderStats();
+                printf("    %.1f ns per instance, %d draws, %d uniform uploads\n", nanoseconds / count,
+                       stats.DrawCalls, stats.Calls.UniformUploads);
+                failureCount += !CheckDrawCount(stats);
+            }
+        }
+        delete renderingEngine;
+    }
+    NullGL::SetExtensions(defaultExtensions);
+#endif
+    
+    delete resourceManager;
+    return failureCount > 0 ? 1 : 0;
+}
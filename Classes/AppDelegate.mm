@@ -23,6 +23,12 @@
 }
 
 
+- (void) applicationDidEnterBackground: (UIApplication*) application
+{
+    [m_view writeFrameReport];
+}
+
+
 - (void)dealloc {
     [m_view release];
     [m_window release];
@@ -0,0 +1,34 @@
+#pragma once
+#include <cmath>
+
+// Sine and cosine of count angles at once, accurate to a few ulp for angles
+// of moderate size. The loop has no branches or library calls, so the
+// compiler turns it into NEON (or SSE) code working on four angles at a time.
+// Range reduction and polynomials follow the Cephes sinf and cosf.
+inline void SinCos(const float* angles, float* sines, float* cosines, int count)
+{
+    const float FourOverPi = 1.27323954473516f;
+    const float PiOver4Part1 = 0.78515625f;
+    const float PiOver4Part2 = 2.4187564849853515625e-4f;
+    const float PiOver4Part3 = 3.77489497744594108e-8f;
+    for (int i = 0; i < count; ++i) {
+        float x = angles[i];
+        float sinSign = x < 0 ? -1.0f : 1.0f;
+        x = std::fabs(x);
+
+        // Reduce to [-Pi/4, Pi/4] around the nearest even multiple of Pi/4.
+        int octant = (int) (x * FourOverPi);
+        octant = (octant + 1) & ~1;
+        float y = (float) octant;
+        x = ((x - y * PiOver4Part1) - y * PiOver4Part2) - y * PiOver4Part3;
+        sinSign *= (float) (1 - ((octant >> 1) & 2));
+        float cosSign = (float) ((((octant - 2) >> 1) & 2) - 1);
+
+        float z = x * x;
+        float cosPoly = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+        float sinPoly = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * x + x;
+        float swap = (float) ((octant >> 1) & 1);
+        sines[i] = sinSign * (sinPoly + swap * (cosPoly - sinPoly));
+        cosines[i] = cosSign * (cosPoly + swap * (sinPoly - cosPoly));
+    }
+}
@@ -7,6 +7,9 @@
 //
 
 #include "ApplicationEngine.hpp"
+#include <dirent.h>
+#include <cstdlib>
+#include <assert.h>
 
 IApplicationEngine * CreateApplicationEngine(IRenderingEngine * renderingEngine, IResourceManager * resourceManager) {
     return new ApplicationEngine(renderingEngine, resourceManager);
@@ -14,16 +17,15 @@ IApplicationEngine * CreateApplicationEngine(IRenderingEngine * renderingEngine,
 
 ApplicationEngine::ApplicationEngine(IRenderingEngine * renderingEngine, IResourceManager * resourceManager) :
     m_spinning(false), m_renderingEngine(renderingEngine), m_pressedButton(-1), m_resourceManager(resourceManager) {
-        m_buttonSurfaces[0] = 0;
-        m_buttonSurfaces[1] = 1;
-        m_buttonSurfaces[2] = 2;
-        m_buttonSurfaces[3] = 4;
-        m_buttonSurfaces[4] = 5;
-        m_currentSurface = 3;
+        m_surfaces = new SurfaceRegistry(renderingEngine, resourceManager->GetCachePath(), SurfaceBudget);
+        m_firstButton = 0;
+        m_currentSurface = SurfaceRegistry::Placeholder;
         m_animation.Active = false;
+        m_needsRedraw = true;
 }
 
 ApplicationEngine::~ApplicationEngine() {
+    delete m_surfaces;
     delete m_renderingEngine;
 }
 
@@ -33,24 +35,77 @@ void ApplicationEngine::Initialize(int width, int height) {
     m_buttonSize.y = m_buttonSize.x;
     m_screenSize = ivec2(width, height);
     m_centerPoint = m_screenSize / 2;
+    m_needsRedraw = true;
     
-    vector<ISurface*>surfaces(SurfaceCount);
+    // Draw a plain sphere for every surface at first, so the first frame doesn't
+    // wait on any load; the real surfaces are made on background threads once
+    // they are shown, and swapped in as they finish
+    Sphere placeholder(1.4);
+    m_surfaces->Initialize(placeholder);
+    
+    // The app's own surfaces first, then whatever other OBJ files it has
     string path = m_resourceManager->GetResourcepath();
-    surfaces[0] = new ObjSurface(path + "/Ninja.obj");
-    surfaces[1] = new Sphere(1.4);
-    surfaces[2] = new Torus(1.4, 0.3);
-    surfaces[3] = new TrefoilKnot(1.8);
-    surfaces[4] = new ObjSurface(path + "/micronapalmv2.obj");
-    surfaces[5] = new MobiusStrip(1);
-    m_renderingEngine->Initialize(surfaces);
-    for (int i = 0; i < SurfaceCount; i++) {
-        delete surfaces[i];
+    m_catalog.push_back(m_surfaces->AddObjFile(path + "/Ninja.obj"));
+    m_catalog.push_back(m_surfaces->AddSurface(new Sphere(1.4)));
+    m_catalog.push_back(m_surfaces->AddSurface(new Torus(1.4, 0.3)));
+    m_catalog.push_back(m_surfaces->AddSurface(new TrefoilKnot(1.8)));
+    m_catalog.push_back(m_surfaces->AddObjFile(path + "/micronapalmv2.obj"));
+    m_catalog.push_back(m_surfaces->AddSurface(new MobiusStrip(1)));
+    vector<string> objFiles;
+    ListObjFiles(path, objFiles);
+    for (size_t i = 0; i < objFiles.size(); i++) {
+        if (objFiles[i] != "Ninja.obj" && objFiles[i] != "micronapalmv2.obj") {
+            m_catalog.push_back(m_surfaces->AddObjFile(path + "/" + objFiles[i]));
+        }
+    }
+    m_currentSurface = m_catalog[3];
+    m_firstButton = 0;
+    ScrollButtons(0);
+    RequestSurfaces();
+}
+
+void ApplicationEngine::ListObjFiles(const string& directory, vector<string>& names) {
+    DIR * listing = opendir(directory.c_str());
+    if (!listing) {
+        return;
+    }
+    while (dirent * entry = readdir(listing)) {
+        string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(listing);
+    sort(names.begin(), names.end());
+}
+
+void ApplicationEngine::ScrollButtons(int pages) {
+    // The buttons show the catalog from m_firstButton on, passing over the
+    // main surface, and wrap round at its end
+    int count = m_catalog.size();
+    assert(count >= VisualCount && "Too few surfaces to fill the buttons.");
+    m_firstButton = ((m_firstButton + pages * ButtonCount) % count + count) % count;
+    int catalogIndex = m_firstButton;
+    for (int buttonIndex = 0; buttonIndex < ButtonCount; ++buttonIndex) {
+        if (m_catalog[catalogIndex] == m_currentSurface) {
+            catalogIndex = (catalogIndex + 1) % count;
+        }
+        m_buttonSurfaces[buttonIndex] = m_catalog[catalogIndex];
+        catalogIndex = (catalogIndex + 1) % count;
+    }
+}
+
+void ApplicationEngine::RequestSurfaces() {
+    m_surfaces->Request(m_currentSurface);
+    for (int buttonIndex = 0; buttonIndex < ButtonCount; ++buttonIndex) {
+        m_surfaces->Request(m_buttonSurfaces[buttonIndex]);
     }
 }
 
 void ApplicationEngine::PopulateVisuals(Visual * visuals) const {
+    // The main surface first, then the buttons in order
     for (int buttonIndex = 0; buttonIndex < ButtonCount; ++buttonIndex) {
-        int visualIndex = m_buttonSurfaces[buttonIndex];
+        int visualIndex = buttonIndex + 1;
         visuals[visualIndex].Color = vec3(0.75, 0.75, 0.75);
         if (m_pressedButton == buttonIndex) {
             visuals[visualIndex].Color = vec3(1.0, 1.0, 1.0);
@@ -58,48 +113,89 @@ void ApplicationEngine::PopulateVisuals(Visual * visuals) const {
         visuals[visualIndex].ViewportSize = m_buttonSize;
         visuals[visualIndex].LowerLeft = ivec2(buttonIndex * m_buttonSize.x, 0);
         visuals[visualIndex].Orientation = Quaternion();
+        visuals[visualIndex].Surface = m_buttonSurfaces[buttonIndex];
     }
-    visuals[m_currentSurface].Color = m_spinning ? vec3(1, 1, 1) : vec3(0, 1, 1);
+    visuals[0].Color = m_spinning ? vec3(1, 1, 1) : vec3(0, 1, 1);
     
-    visuals[m_currentSurface].LowerLeft = ivec2(0, m_buttonSize.y);
-    visuals[m_currentSurface].ViewportSize = ivec2(m_screenSize.x, m_screenSize.y - m_buttonSize.y);
-    visuals[m_currentSurface].Orientation = m_orientation;
+    visuals[0].LowerLeft = ivec2(0, m_buttonSize.y);
+    visuals[0].ViewportSize = ivec2(m_screenSize.x, m_screenSize.y - m_buttonSize.y);
+    visuals[0].Orientation = m_orientation;
+    visuals[0].Surface = m_currentSurface;
 }
 
 void ApplicationEngine::Render() const {
-    vector<Visual> visuals(SurfaceCount);
+    ScopedPhaseTimer timer(m_profiler, FramePhaseRender);
+    m_needsRedraw = false;
+    m_frameArena.Reset();
+    Visual * visuals = m_frameArena.Allocate<Visual>(VisualCount);
     if (!m_animation.Active) {
-        PopulateVisuals(&visuals[0]);
+        PopulateVisuals(visuals);
     } else {
         float t = 0;
         if (m_animation.Duration != 0) {
             t = m_animation.Elapsed / m_animation.Duration;
         }
-        for (int i = 0; i < SurfaceCount; i++) {
-            const Visual & start = m_animation.StartingVisuals[i];
+        for (int i = 0; i < VisualCount; i++) {
+            // From wherever the same surface started out
             const Visual & end = m_animation.EndingVisuals[i];
+            const Visual * starting = &end;
+            for (int j = 0; j < VisualCount; j++) {
+                if (m_animation.StartingVisuals[j].Surface == end.Surface) {
+                    starting = &m_animation.StartingVisuals[j];
+                }
+            }
+            const Visual & start = *starting;
             Visual & tweened = visuals[i];
             
             tweened.Color = start.Color.Lerp(t, end.Color);
             tweened.LowerLeft = start.LowerLeft.Lerp(t, end.LowerLeft);
             tweened.ViewportSize = start.ViewportSize.Lerp(t, end.ViewportSize);
             tweened.Orientation = start.Orientation.Slerp(t, end.Orientation);
+            tweened.Position = start.Position.Lerp(t, end.Position);
+            tweened.Surface = start.Surface;
+        }
+    }
+    for (int i = 0; i < VisualCount; i++) {
+        if (!m_surfaces->IsResident(visuals[i].Surface)) {
+            visuals[i].Surface = SurfaceRegistry::Placeholder;
+            visuals[i].Color = visuals[i].Color * PlaceholderBrightness;
         }
     }
-    m_renderingEngine->Render(visuals);
+    ScopedPhaseTimer engineTimer(m_profiler, FramePhaseEngineRender);
+    m_renderingEngine->Render(VisualList(visuals, VisualCount));
 }
 
 void ApplicationEngine::UpdateAnimation(float timeStep) {
+    ScopedPhaseTimer timer(m_profiler, FramePhaseUpdate);
+    
+    // Keep the surfaces on screen resident, loading those that aren't
+    RequestSurfaces();
+    if (m_surfaces->Update()) {
+        m_needsRedraw = true;
+    }
+    
     if (m_animation.Active) {
         m_animation.Elapsed += timeStep;
         if (m_animation.Elapsed > m_animation.Duration) {
+            // One last frame, to land on the ending visuals
             m_animation.Active = false;
+            m_needsRedraw = true;
         }
     }
 }
 
 void ApplicationEngine::OnFingerUp(ivec2 location) {
+    if (m_spinning || m_pressedButton != -1) {
+        m_needsRedraw = true;
+    }
     m_spinning = false;
+    
+    // A swipe along the buttons pages through the catalog
+    int swipe = location.x - m_fingerStart.x;
+    if (MapToButton(m_fingerStart) != -1 && abs(swipe) >= m_buttonSize.x && !m_animation.Active) {
+        ScrollButtons(swipe < 0 ? 1 : -1);
+        m_needsRedraw = true;
+    }
     if (m_pressedButton != -1 && m_pressedButton == MapToButton(location) && !m_animation.Active) {
         m_animation.Active = true;
         m_animation.Elapsed = 0;
@@ -118,6 +214,7 @@ void ApplicationEngine::OnFingerDown(ivec2 location) {
     if (m_pressedButton == -1) {
         m_spinning = true;
     }
+    m_needsRedraw = true;
 }
 
 void ApplicationEngine::OnFingerMove(ivec2 oldLocation, ivec2 newLocation) {
@@ -126,9 +223,11 @@ void ApplicationEngine::OnFingerMove(ivec2 oldLocation, ivec2 newLocation) {
         vec3 end = MapToSphere(newLocation);
         Quaternion delta = Quaternion::CreateFromVectors(start, end);
         m_orientation = delta.Rotated(m_previousOrientation);
+        m_needsRedraw = true;
     }
     if (m_pressedButton != -1 && m_pressedButton != MapToButton(newLocation)) {
         m_pressedButton = -1;
+        m_needsRedraw = true;
     }
 }
 
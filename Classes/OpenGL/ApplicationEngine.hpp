@@ -10,22 +10,29 @@
 #define WireframeSkeleton_ApplicationEngine_h
 
 #include "Interfaces.hpp"
+#include "FrameArena.hpp"
+#include "FrameProfiler.hpp"
 #include "ObjSurface.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
 #include "ParametricEquations.hpp"
+#include "SurfaceRegistry.hpp"
 #include <algorithm>
 
 using namespace std;
 
-static const int SurfaceCount = 6;
-static const int ButtonCount = SurfaceCount - 1;
+static const int ButtonCount = 5;
+static const int VisualCount = ButtonCount + 1; // The main surface and the buttons
 static const float AnimationDuration = 0.3;
+static const float PlaceholderBrightness = 0.35;
+static const size_t SurfaceBudget = 16 << 20; // Bytes of the rendering engine's memory
 
 struct Animation {
     bool Active;
     float Elapsed;
     float Duration;
-    Visual StartingVisuals[SurfaceCount];
-    Visual EndingVisuals[SurfaceCount];
+    Visual StartingVisuals[VisualCount];
+    Visual EndingVisuals[VisualCount];
 };
 
 class ApplicationEngine : public IApplicationEngine {
@@ -38,8 +45,17 @@ public:
     void OnFingerUp(ivec2 location);
     void OnFingerDown(ivec2 location);
     void OnFingerMove(ivec2 oldLocation, ivec2 newLocation);
+    bool IsLoading() const { return m_surfaces->IsLoading(); }
+    bool NeedsRedraw() const { return m_needsRedraw || m_animation.Active; }
+    RenderStats GetRenderStats() const { return m_renderingEngine->GetRenderStats(); }
+    SurfaceStats GetSurfaceStats() const { return m_surfaces->GetStats(); }
+    void SetSurfaceBudget(size_t bytes) { m_surfaces->SetBudget(bytes); }
+    FrameProfiler& GetFrameProfiler() { return m_profiler; }
 private:
     void PopulateVisuals(Visual * visuals) const;
+    static void ListObjFiles(const string& directory, vector<string>& names);
+    void RequestSurfaces();
+    void ScrollButtons(int pages);
     int MapToButton(ivec2 touchPoint) const;
     vec3 MapToSphere(ivec2 touchPoint) const;
     float m_trackballRadius;
@@ -51,11 +67,17 @@ private:
     Quaternion m_previousOrientation;
     IRenderingEngine * m_renderingEngine;
     IResourceManager * m_resourceManager;
+    SurfaceRegistry * m_surfaces;
+    vector<int> m_catalog; // Every surface there is to browse, as handles
+    int m_firstButton; // Where in the catalog the buttons start
     int m_currentSurface;
     ivec2 m_buttonSize;
     int m_pressedButton;
     int m_buttonSurfaces[ButtonCount];
     Animation m_animation;
+    mutable bool m_needsRedraw; // Set by whatever changes the visuals, cleared by Render
+    mutable FrameProfiler m_profiler;
+    mutable FrameArena m_frameArena; // What Render builds, freed by the next one
 };
 
 #endif
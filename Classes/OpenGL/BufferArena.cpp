@@ -0,0 +1,130 @@
+//
+//  BufferArena.cpp
+//  ModelViewer
+//
+
+#include "BufferArena.hpp"
+#include <algorithm>
+#include <assert.h>
+
+typedef std::map<size_t, size_t> RangeMap;
+
+bool ArenaBlock::operator<(const ArenaBlock& block) const
+{
+    if (Buffer != block.Buffer)
+        return Buffer < block.Buffer;
+    return Offset < block.Offset;
+}
+
+std::ostream& operator<<(std::ostream& stream, const ArenaStats& stats)
+{
+    return stream << stats.PageCount << " buffers, " << stats.BytesUsed / 1024 << " KB used of "
+                  << stats.BytesReserved / 1024 << " KB, " << stats.FreeRangeCount << " free ranges, largest "
+                  << stats.LargestFreeRange / 1024 << " KB";
+}
+
+BufferArena::BufferArena(size_t pageSize, size_t alignment) :
+m_pageSize(pageSize),
+m_alignment(alignment)
+{
+}
+
+size_t BufferArena::Align(size_t size) const
+{
+    return (size + m_alignment - 1) / m_alignment * m_alignment;
+}
+
+bool BufferArena::Allocate(size_t size, ArenaBlock& block)
+{
+    size = Align(size);
+    
+    // Best fit over every page
+    Page* bestPage = 0;
+    RangeMap::iterator best;
+    for (std::vector<Page>::iterator page = m_pages.begin(); page != m_pages.end(); ++page) {
+        for (RangeMap::iterator range = page->FreeRanges.begin(); range != page->FreeRanges.end(); ++range) {
+            if (range->second >= size && (!bestPage || range->second < best->second)) {
+                bestPage = &*page;
+                best = range;
+            }
+        }
+    }
+    if (!bestPage)
+        return false;
+    
+    // Take the start of the range, leaving the rest free
+    size_t offset = best->first;
+    size_t remaining = best->second - size;
+    bestPage->FreeRanges.erase(best);
+    if (remaining > 0)
+        bestPage->FreeRanges[offset + size] = remaining;
+    bestPage->Blocks[offset] = size;
+    bestPage->Used += size;
+    block.Buffer = bestPage->Buffer;
+    block.Offset = offset;
+    return true;
+}
+
+size_t BufferArena::GetNewPageSize(size_t size) const
+{
+    return std::max(m_pageSize, Align(size));
+}
+
+void BufferArena::AddPage(unsigned int buffer, size_t size)
+{
+    Page page;
+    page.Buffer = buffer;
+    page.Size = size;
+    page.Used = 0;
+    page.FreeRanges[0] = size;
+    m_pages.push_back(page);
+}
+
+bool BufferArena::Free(const ArenaBlock& block)
+{
+    std::vector<Page>::iterator page = m_pages.begin();
+    while (page != m_pages.end() && page->Buffer != block.Buffer)
+        ++page;
+    assert(page != m_pages.end() && "Block from another arena.");
+    RangeMap::iterator allocated = page->Blocks.find(block.Offset);
+    assert(allocated != page->Blocks.end() && "Block already freed.");
+    size_t offset = allocated->first;
+    size_t size = allocated->second;
+    page->Blocks.erase(allocated);
+    page->Used -= size;
+    if (page->Blocks.empty()) {
+        m_pages.erase(page);
+        return true;
+    }
+    
+    // Merge with the free ranges either side
+    RangeMap& ranges = page->FreeRanges;
+    RangeMap::iterator next = ranges.lower_bound(offset);
+    if (next != ranges.end() && offset + size == next->first) {
+        size += next->second;
+        ranges.erase(next++);
+    }
+    if (next != ranges.begin()) {
+        RangeMap::iterator previous = next;
+        --previous;
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return false;
+        }
+    }
+    ranges[offset] = size;
+    return false;
+}
+
+ArenaStats BufferArena::GetStats() const
+{
+    ArenaStats stats = { (int) m_pages.size(), 0, 0, 0, 0 };
+    for (std::vector<Page>::const_iterator page = m_pages.begin(); page != m_pages.end(); ++page) {
+        stats.BytesReserved += page->Size;
+        stats.BytesUsed += page->Used;
+        stats.FreeRangeCount += page->FreeRanges.size();
+        for (RangeMap::const_iterator range = page->FreeRanges.begin(); range != page->FreeRanges.end(); ++range)
+            stats.LargestFreeRange = std::max(stats.LargestFreeRange, range->second);
+    }
+    return stats;
+}
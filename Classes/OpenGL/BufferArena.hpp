@@ -0,0 +1,68 @@
+//
+//  BufferArena.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_BufferArena_h
+#define ModelViewer_BufferArena_h
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <vector>
+
+// Size of the buffers an arena sub-allocates from; bigger requests get a
+// buffer of their own.
+const size_t ArenaPageSize = 4 << 20;
+
+// A range sub-allocated from one of an arena's buffers.
+struct ArenaBlock {
+    unsigned int Buffer;
+    size_t Offset; // In bytes from the start of Buffer
+    bool operator<(const ArenaBlock& block) const;
+};
+
+struct ArenaStats {
+    int PageCount;
+    size_t BytesReserved; // Total size of the buffers
+    size_t BytesUsed;
+    int FreeRangeCount;
+    size_t LargestFreeRange;
+};
+
+std::ostream& operator<<(std::ostream& stream, const ArenaStats& stats);
+
+// Packs many vertex or index arrays into a few large buffers, so drawing
+// rebinds rarely. Each buffer, or page, keeps its free ranges sorted by
+// offset and merges them with their neighbours as blocks are freed; blocks
+// go in the smallest free range they fit, to keep the large ones whole.
+// Like GeometryRegistry it keeps no GL state: the rendering engine creates
+// a buffer when asked for a new page and deletes it once the page empties.
+class BufferArena {
+public:
+    // Blocks start on multiples of alignment bytes.
+    BufferArena(size_t pageSize = ArenaPageSize, size_t alignment = 4);
+    // Finds room for size bytes; false means no page has any, and the caller
+    // should add one of GetNewPageSize(size) bytes and try again.
+    bool Allocate(size_t size, ArenaBlock& block);
+    size_t GetNewPageSize(size_t size) const;
+    void AddPage(unsigned int buffer, size_t size);
+    // Returns true when this emptied the block's page, which is dropped; its
+    // buffer should then be deleted.
+    bool Free(const ArenaBlock& block);
+    ArenaStats GetStats() const;
+private:
+    struct Page {
+        unsigned int Buffer;
+        size_t Size;
+        size_t Used;
+        std::map<size_t, size_t> FreeRanges; // Size by offset
+        std::map<size_t, size_t> Blocks; // Size by offset
+    };
+    size_t Align(size_t size) const;
+    std::vector<Page> m_pages;
+    size_t m_pageSize;
+    size_t m_alignment;
+};
+
+#endif
@@ -0,0 +1,54 @@
+//
+//  FrameArena.cpp
+//  ModelViewer
+//
+
+#include "FrameArena.hpp"
+#include <assert.h>
+
+FrameArena::FrameArena(size_t capacity) :
+m_block(new char[capacity]),
+m_capacity(capacity),
+m_used(0),
+m_overflowBytes(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for (size_t i = 0; i < m_overflow.size(); ++i)
+        delete[] m_overflow[i];
+    delete[] m_block;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    assert((alignment & (alignment - 1)) == 0 && "Alignment must be a power of two.");
+    size_t address = (size_t) (m_block + m_used);
+    size_t padding = (alignment - address % alignment) % alignment;
+    if (m_used + padding + size <= m_capacity) {
+        m_used += padding + size;
+        return m_block + m_used - size;
+    }
+    
+    // Over capacity: a block of its own, until the next Reset grows the arena
+    char* overflow = new char[size + alignment];
+    m_overflow.push_back(overflow);
+    m_overflowBytes += size + alignment;
+    address = (size_t) overflow;
+    return overflow + (alignment - address % alignment) % alignment;
+}
+
+void FrameArena::Reset()
+{
+    if (!m_overflow.empty()) {
+        for (size_t i = 0; i < m_overflow.size(); ++i)
+            delete[] m_overflow[i];
+        m_overflow.clear();
+        delete[] m_block;
+        m_capacity = m_used + m_overflowBytes;
+        m_block = new char[m_capacity];
+    }
+    m_used = 0;
+    m_overflowBytes = 0;
+}
@@ -0,0 +1,48 @@
+//
+//  FrameArena.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_FrameArena_h
+#define ModelViewer_FrameArena_h
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// A linear allocator for memory that only lives for one frame: allocating
+// bumps an offset through one block, and Reset frees everything at once.
+// A frame that outgrows the block takes the rest from overflow blocks, and
+// the next Reset swaps them all for one block big enough for that frame,
+// so once frames stop growing the arena never touches the heap. Nothing is
+// destroyed, so it only holds types with trivial destructors.
+class FrameArena {
+public:
+    FrameArena(size_t capacity = 4096);
+    ~FrameArena();
+    // size bytes starting on a multiple of alignment, a power of two.
+    void* Allocate(size_t size, size_t alignment = 16);
+    // count default-constructed objects.
+    template <typename T>
+    T* Allocate(int count)
+    {
+        T* objects = (T*) Allocate(count * sizeof(T));
+        for (int i = 0; i < count; ++i)
+            new (objects + i) T();
+        return objects;
+    }
+    void Reset();
+    size_t GetCapacity() const { return m_capacity; }
+    // Bytes handed out since the last Reset, alignment included.
+    size_t GetBytesUsed() const { return m_used + m_overflowBytes; }
+private:
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+    char* m_block;
+    size_t m_capacity;
+    size_t m_used;
+    std::vector<char*> m_overflow;
+    size_t m_overflowBytes;
+};
+
+#endif
@@ -0,0 +1,182 @@
+//
+//  FrameProfiler.cpp
+//  ModelViewer
+//
+
+#include "FrameProfiler.hpp"
+#include <fstream>
+#include <cstdio>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+static const char* PhaseNames[FramePhaseCount] = { "Update", "Render", "EngineRender", "Present", "Frame" };
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+int LatencyHistogram::GetBucket(unsigned long long nanoseconds)
+{
+    if (nanoseconds < SubBucketCount)
+        return nanoseconds;
+    
+    // The top SubBucketBits bits below the leading one pick the step
+    int shift = 63 - __builtin_clzll(nanoseconds) - SubBucketBits;
+    return (shift + 1) * SubBucketCount + ((nanoseconds >> shift) & (SubBucketCount - 1));
+}
+
+unsigned long long LatencyHistogram::GetBucketStart(int bucket)
+{
+    if (bucket < SubBucketCount)
+        return bucket;
+    int shift = bucket / SubBucketCount - 1;
+    return (unsigned long long) (SubBucketCount + bucket % SubBucketCount) << shift;
+}
+
+void LatencyHistogram::Record(unsigned long long nanoseconds)
+{
+    __sync_fetch_and_add(&m_buckets[GetBucket(nanoseconds)], 1);
+    __sync_fetch_and_add(&m_count, 1);
+    __sync_fetch_and_add(&m_total, (long long) nanoseconds);
+    long long max = m_max;
+    while ((long long) nanoseconds > max && !__sync_bool_compare_and_swap(&m_max, max, (long long) nanoseconds))
+        max = m_max;
+}
+
+void LatencyHistogram::Reset()
+{
+    for (int i = 0; i < BucketCount; ++i)
+        m_buckets[i] = 0;
+    m_count = 0;
+    m_total = 0;
+    m_max = 0;
+}
+
+double LatencyHistogram::GetPercentile(double fraction) const
+{
+    int count = m_count;
+    if (count == 0)
+        return 0;
+    
+    // The last duration of the bucket holding the sample ranked fraction
+    // through, but no more than the largest one seen
+    long long rank = (long long) (fraction * count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    long long seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket) {
+        seen += m_buckets[bucket];
+        if (seen >= rank) {
+            unsigned long long end = bucket + 1 < BucketCount ? GetBucketStart(bucket + 1) - 1 : m_max;
+            return (end < (unsigned long long) m_max ? end : m_max) * 1e-9;
+        }
+    }
+    return GetMax();
+}
+
+double LatencyHistogram::GetMean() const
+{
+    int count = m_count;
+    return count > 0 ? m_total * 1e-9 / count : 0;
+}
+
+double LatencyHistogram::GetMax() const
+{
+    return m_max * 1e-9;
+}
+
+FrameProfiler::FrameProfiler(double frameBudget) :
+m_frameBudget(frameBudget * 1e9),
+m_frameStart(0),
+m_overrunCount(0),
+m_skippedCount(0)
+{
+}
+
+unsigned long long FrameProfiler::GetNanoseconds()
+{
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+#endif
+}
+
+void FrameProfiler::BeginFrame()
+{
+    m_frameStart = GetNanoseconds();
+}
+
+void FrameProfiler::EndFrame()
+{
+    unsigned long long duration = GetNanoseconds() - m_frameStart;
+    Record(FramePhaseFrame, duration);
+    if (duration > m_frameBudget)
+        __sync_fetch_and_add(&m_overrunCount, 1);
+}
+
+void FrameProfiler::Record(FramePhase phase, unsigned long long nanoseconds)
+{
+    m_histograms[phase].Record(nanoseconds);
+}
+
+PhaseStats FrameProfiler::GetPhaseStats(FramePhase phase) const
+{
+    const LatencyHistogram& histogram = m_histograms[phase];
+    PhaseStats stats = {
+        PhaseNames[phase], histogram.GetCount(), histogram.GetMean(), histogram.GetPercentile(0.5),
+        histogram.GetPercentile(0.99), histogram.GetMax()
+    };
+    return stats;
+}
+
+void FrameProfiler::Reset()
+{
+    for (int phase = 0; phase < FramePhaseCount; ++phase)
+        m_histograms[phase].Reset();
+    m_overrunCount = 0;
+    m_skippedCount = 0;
+}
+
+void FrameProfiler::Report(std::ostream& stream) const
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%d frames, %d over the %.2f ms budget, %d skipped\n", GetFrameCount(),
+             m_overrunCount, m_frameBudget * 1e-6, m_skippedCount);
+    stream << line;
+    for (int phase = 0; phase < FramePhaseCount; ++phase) {
+        PhaseStats stats = GetPhaseStats((FramePhase) phase);
+        snprintf(line, sizeof(line), "%-12s %8d %10.3f ms mean %10.3f ms p50 %10.3f ms p99 %10.3f ms max\n",
+                 stats.Name, stats.Count, stats.Mean * 1e3, stats.Median * 1e3, stats.P99 * 1e3, stats.Max * 1e3);
+        stream << line;
+    }
+    
+    // phase, bucket start in nanoseconds, samples
+    for (int phase = 0; phase < FramePhaseCount; ++phase) {
+        const LatencyHistogram& histogram = m_histograms[phase];
+        for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket) {
+            if (histogram.GetBucketSampleCount(bucket) > 0) {
+                stream << PhaseNames[phase] << "," << LatencyHistogram::GetBucketStart(bucket) << ","
+                       << histogram.GetBucketSampleCount(bucket) << "\n";
+            }
+        }
+    }
+}
+
+bool FrameProfiler::WriteReport(const std::string& path) const
+{
+    std::ofstream file(path.c_str());
+    if (!file)
+        return false;
+    Report(file);
+    return file.good();
+}
@@ -0,0 +1,109 @@
+//
+//  FrameProfiler.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_FrameProfiler_h
+#define ModelViewer_FrameProfiler_h
+
+#include <ostream>
+#include <string>
+
+// Durations in nanoseconds, counted in buckets a power of two wide, each
+// split into 16 steps: any duration is known to within 1/16th, from
+// nanoseconds to hours, in a few kilobytes. Recording is lock-free, so it
+// may run on any thread while another reads.
+class LatencyHistogram {
+public:
+    enum { SubBucketBits = 4, SubBucketCount = 1 << SubBucketBits, BucketCount = (64 - SubBucketBits + 1) * SubBucketCount };
+    LatencyHistogram();
+    void Record(unsigned long long nanoseconds);
+    void Reset();
+    int GetCount() const { return m_count; }
+    // The duration, in seconds, that fraction of the samples take at most.
+    double GetPercentile(double fraction) const;
+    double GetMean() const;
+    double GetMax() const;
+    int GetBucketSampleCount(int bucket) const { return m_buckets[bucket]; }
+    // The smallest duration counted in bucket, in nanoseconds.
+    static unsigned long long GetBucketStart(int bucket);
+private:
+    static int GetBucket(unsigned long long nanoseconds);
+    volatile int m_buckets[BucketCount];
+    volatile int m_count;
+    volatile long long m_total;
+    volatile long long m_max;
+};
+
+// What a frame spends its time on. Render includes EngineRender; Frame runs
+// from BeginFrame to EndFrame and includes them all.
+enum FramePhase {
+    FramePhaseUpdate,
+    FramePhaseRender,
+    FramePhaseEngineRender,
+    FramePhasePresent,
+    FramePhaseFrame,
+    FramePhaseCount
+};
+
+struct PhaseStats {
+    const char* Name;
+    int Count;
+    double Mean; // Seconds
+    double Median;
+    double P99;
+    double Max;
+};
+
+// A histogram of how long each phase of a frame takes, and a count of the
+// frames that ran over the display's budget. Meant to stay on in release
+// builds: timing a phase costs two clock reads and a few atomic adds.
+class FrameProfiler {
+public:
+    FrameProfiler(double frameBudget = 1.0 / 60);
+    void SetFrameBudget(double seconds) { m_frameBudget = seconds * 1e9; }
+    void BeginFrame();
+    // Records the Frame phase, counting it as an overrun if over budget.
+    void EndFrame();
+    // Ends a frame that had nothing new to draw, and so wasn't drawn.
+    void SkipFrame() { __sync_fetch_and_add(&m_skippedCount, 1); }
+    void Record(FramePhase phase, unsigned long long nanoseconds);
+    PhaseStats GetPhaseStats(FramePhase phase) const;
+    const LatencyHistogram& GetHistogram(FramePhase phase) const { return m_histograms[phase]; }
+    int GetFrameCount() const { return m_histograms[FramePhaseFrame].GetCount(); }
+    int GetOverrunCount() const { return m_overrunCount; }
+    int GetSkippedFrameCount() const { return m_skippedCount; }
+    void Reset();
+    // A summary line per phase, then every non-empty bucket.
+    void Report(std::ostream& stream) const;
+    bool WriteReport(const std::string& path) const;
+    // A monotonic clock.
+    static unsigned long long GetNanoseconds();
+private:
+    LatencyHistogram m_histograms[FramePhaseCount];
+    unsigned long long m_frameBudget; // Nanoseconds
+    unsigned long long m_frameStart;
+    volatile int m_overrunCount;
+    volatile int m_skippedCount;
+};
+
+// Records how long the enclosing scope took as phase.
+class ScopedPhaseTimer {
+public:
+    ScopedPhaseTimer(FrameProfiler& profiler, FramePhase phase) :
+    m_profiler(profiler),
+    m_phase(phase),
+    m_start(FrameProfiler::GetNanoseconds())
+    {
+    }
+    ~ScopedPhaseTimer()
+    {
+        m_profiler.Record(m_phase, FrameProfiler::GetNanoseconds() - m_start);
+    }
+private:
+    FrameProfiler& m_profiler;
+    FramePhase m_phase;
+    unsigned long long m_start;
+};
+
+#endif
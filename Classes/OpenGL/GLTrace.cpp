@@ -0,0 +1,20 @@
+//
+//  GLTrace.cpp
+//  ModelViewer
+//
+
+#include "Interfaces.hpp"
+
+namespace GLTrace {
+
+GLCallCounts Counts;
+
+GLCallCounts TakeCounts()
+{
+    GLCallCounts counts = Counts;
+    GLCallCounts none = {};
+    Counts = none;
+    return counts;
+}
+
+}
@@ -0,0 +1,248 @@
+//
+//  GLTrace.hpp
+//  ModelViewer
+//
+//  Counts the GL calls the rendering engines make. Include it after the GL
+//  headers and everything else; when MODELVIEWER_TRACE_GL is defined the GL
+//  entry points below are redirected through counting wrappers, otherwise
+//  the calls go straight to GL and the counts stay zero.
+//
+
+#ifndef ModelViewer_GLTrace_h
+#define ModelViewer_GLTrace_h
+
+#include "Interfaces.hpp"
+
+namespace GLTrace {
+
+// The counts since the last call, which resets them. GL runs on one thread.
+GLCallCounts TakeCounts();
+
+#ifdef MODELVIEWER_TRACE_GL
+
+extern GLCallCounts Counts;
+
+inline void CountDraw(GLenum mode, GLsizei count, GLsizei instanceCount = 1)
+{
+    Counts.DrawCalls++;
+    if (mode == GL_TRIANGLES)
+        Counts.Triangles += count / 3 * instanceCount;
+    else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+        Counts.Triangles += (count > 2 ? count - 2 : 0) * instanceCount;
+}
+
+inline void DrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices)
+{
+    CountDraw(mode, count);
+    glDrawElements(mode, count, type, indices);
+}
+
+inline void DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    CountDraw(mode, count);
+    glDrawArrays(mode, first, count);
+}
+
+inline void BindBuffer(GLenum target, GLuint buffer)
+{
+    Counts.BufferBinds++;
+    glBindBuffer(target, buffer);
+}
+
+inline void BufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
+{
+    if (data)
+        Counts.BytesUploaded += size;
+    glBufferData(target, size, data, usage);
+}
+
+inline void BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data)
+{
+    Counts.BytesUploaded += size;
+    glBufferSubData(target, offset, size, data);
+}
+
+inline void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    Counts.StateChanges++;
+    glViewport(x, y, width, height);
+}
+
+inline void Enable(GLenum capability)
+{
+    Counts.StateChanges++;
+    glEnable(capability);
+}
+
+inline void Disable(GLenum capability)
+{
+    Counts.StateChanges++;
+    glDisable(capability);
+}
+
+inline void Scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    Counts.StateChanges++;
+    glScissor(x, y, width, height);
+}
+
+inline void ClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+{
+    Counts.StateChanges++;
+    glClearColor(red, green, blue, alpha);
+}
+
+#ifdef GL_ES_VERSION_2_0
+
+inline void UseProgram(GLuint program)
+{
+    Counts.StateChanges++;
+    glUseProgram(program);
+}
+
+inline void VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                const GLvoid* pointer)
+{
+    Counts.StateChanges++;
+    glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+inline void EnableVertexAttribArray(GLuint index)
+{
+    Counts.StateChanges++;
+    glEnableVertexAttribArray(index);
+}
+
+inline void DisableVertexAttribArray(GLuint index)
+{
+    Counts.StateChanges++;
+    glDisableVertexAttribArray(index);
+}
+
+inline void VertexAttribDivisorEXT(GLuint index, GLuint divisor)
+{
+    Counts.StateChanges++;
+    glVertexAttribDivisorEXT(index, divisor);
+}
+
+inline void DrawElementsInstancedEXT(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices,
+                                     GLsizei instanceCount)
+{
+    CountDraw(mode, count, instanceCount);
+    glDrawElementsInstancedEXT(mode, count, type, indices, instanceCount);
+}
+
+inline void VertexAttrib4fv(GLuint index, const GLfloat* values)
+{
+    Counts.StateChanges++;
+    glVertexAttrib4fv(index, values);
+}
+
+inline void Uniform1f(GLint location, GLfloat value)
+{
+    Counts.UniformUploads++;
+    glUniform1f(location, value);
+}
+
+inline void Uniform4fv(GLint location, GLsizei count, const GLfloat* values)
+{
+    Counts.UniformUploads++;
+    glUniform4fv(location, count, values);
+}
+
+inline void Uniform3fv(GLint location, GLsizei count, const GLfloat* values)
+{
+    Counts.UniformUploads++;
+    glUniform3fv(location, count, values);
+}
+
+inline void UniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* values)
+{
+    Counts.UniformUploads++;
+    glUniformMatrix3fv(location, count, transpose, values);
+}
+
+inline void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* values)
+{
+    Counts.UniformUploads++;
+    glUniformMatrix4fv(location, count, transpose, values);
+}
+
+#define glUseProgram GLTrace::UseProgram
+#define glVertexAttribPointer GLTrace::VertexAttribPointer
+#define glEnableVertexAttribArray GLTrace::EnableVertexAttribArray
+#define glDisableVertexAttribArray GLTrace::DisableVertexAttribArray
+#define glVertexAttribDivisorEXT GLTrace::VertexAttribDivisorEXT
+#define glDrawElementsInstancedEXT GLTrace::DrawElementsInstancedEXT
+#define glUniform1f GLTrace::Uniform1f
+#define glUniform4fv GLTrace::Uniform4fv
+#define glVertexAttrib4fv GLTrace::VertexAttrib4fv
+#define glUniform3fv GLTrace::Uniform3fv
+#define glUniformMatrix3fv GLTrace::UniformMatrix3fv
+#define glUniformMatrix4fv GLTrace::UniformMatrix4fv
+
+#endif
+
+#ifdef GL_VERSION_ES_CM_1_0
+
+inline void MatrixMode(GLenum mode)
+{
+    Counts.StateChanges++;
+    glMatrixMode(mode);
+}
+
+inline void LoadMatrixf(const GLfloat* matrix)
+{
+    Counts.UniformUploads++;
+    glLoadMatrixf(matrix);
+}
+
+inline void Lightfv(GLenum light, GLenum name, const GLfloat* values)
+{
+    Counts.UniformUploads++;
+    glLightfv(light, name, values);
+}
+
+inline void Materialfv(GLenum face, GLenum name, const GLfloat* values)
+{
+    Counts.UniformUploads++;
+    glMaterialfv(face, name, values);
+}
+
+inline void VertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid* pointer)
+{
+    Counts.StateChanges++;
+    glVertexPointer(size, type, stride, pointer);
+}
+
+inline void NormalPointer(GLenum type, GLsizei stride, const GLvoid* pointer)
+{
+    Counts.StateChanges++;
+    glNormalPointer(type, stride, pointer);
+}
+
+#define glMatrixMode GLTrace::MatrixMode
+#define glLoadMatrixf GLTrace::LoadMatrixf
+#define glLightfv GLTrace::Lightfv
+#define glMaterialfv GLTrace::Materialfv
+#define glVertexPointer GLTrace::VertexPointer
+#define glNormalPointer GLTrace::NormalPointer
+
+#endif
+
+#define glDrawElements GLTrace::DrawElements
+#define glDrawArrays GLTrace::DrawArrays
+#define glBindBuffer GLTrace::BindBuffer
+#define glBufferData GLTrace::BufferData
+#define glBufferSubData GLTrace::BufferSubData
+#define glViewport GLTrace::Viewport
+#define glEnable GLTrace::Enable
+#define glDisable GLTrace::Disable
+#define glScissor GLTrace::Scissor
+#define glClearColor GLTrace::ClearColor
+
+#endif
+
+}
+
+#endif
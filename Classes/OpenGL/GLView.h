@@ -13,5 +13,7 @@
 }
 
 - (void) drawView: (CADisplayLink*) displayLink;
+// Writes the frame timings so far to Documents/FrameReport.txt.
+- (BOOL) writeFrameReport;
 
 @end
@@ -1,4 +1,5 @@
 #import "GLView.h"
+#import "FrameProfiler.hpp"
 #import <OpenGLES/ES2/gl.h> // <-- for GL_RENDERBUFFER only
 
 #if GL_1_1
@@ -7,6 +8,9 @@ const bool ForceES1 = true;
 const bool ForceES1 = false;
 #endif
 
+// Redraw only the viewports that changed, keeping the rest of the last frame
+const bool PartialRedraw = true;
+
 @implementation GLView
 
 + (Class) layerClass
@@ -20,6 +24,11 @@ const bool ForceES1 = false;
     {
         CAEAGLLayer* eaglLayer = (CAEAGLLayer*) self.layer;
         eaglLayer.opaque = YES;
+        if (PartialRedraw) {
+            eaglLayer.drawableProperties = [NSDictionary dictionaryWithObjectsAndKeys:
+                                            [NSNumber numberWithBool:YES], kEAGLDrawablePropertyRetainedBacking,
+                                            kEAGLColorFormatRGBA8, kEAGLDrawablePropertyColorFormat, nil];
+        }
 
         EAGLRenderingAPI api = kEAGLRenderingAPIOpenGLES2;
         m_context = [[EAGLContext alloc] initWithAPI:api];
@@ -40,7 +49,8 @@ const bool ForceES1 = false;
             m_renderingEngine = ES1::CreateRenderingEngine();
         } else {
             NSLog(@"Using OpenGL ES 2.0");
-            m_renderingEngine = ES2::CreateRenderingEngine();
+            m_renderingEngine = ES2::CreateRenderingEngine(VertexFormatFloat,
+                                                           PartialRedraw ? RedrawModePartial : RedrawModeFull);
         }
         
         m_resourceManager = CreateResourceManager();
@@ -71,14 +81,37 @@ const bool ForceES1 = false;
 
 - (void) drawView: (CADisplayLink*) displayLink
 {
+    FrameProfiler& profiler = m_applicationEngine->GetFrameProfiler();
+    profiler.BeginFrame();
     if (displayLink != nil) {
         float elapsedSeconds = displayLink.timestamp - m_timestamp;
         m_timestamp = displayLink.timestamp;
         m_applicationEngine->UpdateAnimation(elapsedSeconds);
+        
+        // The budget is whatever the display refreshes at
+        if (displayLink.duration > 0)
+            profiler.SetFrameBudget(displayLink.duration * displayLink.frameInterval);
+    }
+    
+    // Nothing changed: the last frame presented is still on screen
+    if (!m_applicationEngine->NeedsRedraw()) {
+        profiler.SkipFrame();
+        return;
     }
     
     m_applicationEngine->Render();
-    [m_context presentRenderbuffer:GL_RENDERBUFFER];
+    {
+        ScopedPhaseTimer timer(profiler, FramePhasePresent);
+        [m_context presentRenderbuffer:GL_RENDERBUFFER];
+    }
+    profiler.EndFrame();
+}
+
+- (BOOL) writeFrameReport
+{
+    NSString* documents = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+    NSString* path = [documents stringByAppendingPathComponent:@"FrameReport.txt"];
+    return m_applicationEngine->GetFrameProfiler().WriteReport([path fileSystemRepresentation]);
 }
 
 - (void) touchesBegan: (NSSet*) touches withEvent: (UIEvent*) event
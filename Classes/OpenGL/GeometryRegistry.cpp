@@ -0,0 +1,72 @@
+//
+//  GeometryRegistry.cpp
+//  ModelViewer
+//
+
+#include "GeometryRegistry.hpp"
+#include "MeshCache.hpp"
+#include <assert.h>
+
+bool GeometryKey::operator<(const GeometryKey& key) const
+{
+    if (Target != key.Target)
+        return Target < key.Target;
+    if (Size != key.Size)
+        return Size < key.Size;
+    return Hash < key.Hash;
+}
+
+std::ostream& operator<<(std::ostream& stream, const GeometryStats& stats)
+{
+    return stream << stats.BlockCount << " arrays for " << stats.ReferenceCount << " uses, "
+                  << stats.BytesStored / 1024 << " KB stored, " << stats.BytesSaved / 1024 << " KB saved by sharing";
+}
+
+GeometryKey GeometryRegistry::MakeKey(unsigned int target, const void* data, size_t size)
+{
+    const char* bytes = (const char*) data;
+    GeometryKey key = { target, size, HashBytes(bytes, bytes + size) };
+    return key;
+}
+
+bool GeometryRegistry::Acquire(const GeometryKey& key, ArenaBlock& block)
+{
+    std::map<GeometryKey, ArenaBlock>::const_iterator found = m_blocks.find(key);
+    if (found == m_blocks.end())
+        return false;
+    m_entries[found->second].References++;
+    block = found->second;
+    return true;
+}
+
+void GeometryRegistry::Insert(const GeometryKey& key, const ArenaBlock& block)
+{
+    assert(m_blocks.find(key) == m_blocks.end() && "Data already registered.");
+    Entry entry = { key, 1 };
+    m_blocks[key] = block;
+    m_entries[block] = entry;
+}
+
+bool GeometryRegistry::Release(const ArenaBlock& block)
+{
+    std::map<ArenaBlock, Entry>::iterator entry = m_entries.find(block);
+    assert(entry != m_entries.end() && "Unknown block.");
+    if (--entry->second.References > 0)
+        return false;
+    m_blocks.erase(entry->second.Key);
+    m_entries.erase(entry);
+    return true;
+}
+
+GeometryStats GeometryRegistry::GetStats() const
+{
+    GeometryStats stats = { 0, 0, 0, 0 };
+    std::map<ArenaBlock, Entry>::const_iterator entry;
+    for (entry = m_entries.begin(); entry != m_entries.end(); ++entry) {
+        stats.BlockCount++;
+        stats.ReferenceCount += entry->second.References;
+        stats.BytesStored += entry->second.Key.Size;
+        stats.BytesSaved += entry->second.Key.Size * (entry->second.References - 1);
+    }
+    return stats;
+}
@@ -0,0 +1,56 @@
+//
+//  GeometryRegistry.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_GeometryRegistry_h
+#define ModelViewer_GeometryRegistry_h
+
+#include "BufferArena.hpp"
+#include <cstddef>
+#include <map>
+#include <ostream>
+
+// Identifies a buffer's contents: its target, size and a 64-bit hash of the
+// bytes, so the data itself need not be kept around to compare against.
+struct GeometryKey {
+    unsigned int Target;
+    size_t Size;
+    unsigned long long Hash;
+    bool operator<(const GeometryKey& key) const;
+};
+
+struct GeometryStats {
+    int BlockCount; // Distinct arrays stored
+    int ReferenceCount; // Uses of them, one per drawable
+    size_t BytesStored; // Total size of the distinct arrays
+    size_t BytesSaved; // What the repeated uses would have added without sharing
+};
+
+std::ostream& operator<<(std::ostream& stream, const GeometryStats& stats);
+
+// Arena blocks keyed by their contents, so identical vertex or index arrays
+// are uploaded once and shared by every surface drawing them. Blocks are
+// reference counted; the rendering engine allocates and frees them and tells
+// the registry, which keeps no GL state of its own.
+class GeometryRegistry {
+public:
+    static GeometryKey MakeKey(unsigned int target, const void* data, size_t size);
+    // Finds the block already holding this data and adds a reference to it.
+    bool Acquire(const GeometryKey& key, ArenaBlock& block);
+    // Records a block just filled with key's data, with one reference.
+    void Insert(const GeometryKey& key, const ArenaBlock& block);
+    // Drops a reference; returns true when it was the last one, and the
+    // block should be freed.
+    bool Release(const ArenaBlock& block);
+    GeometryStats GetStats() const;
+private:
+    struct Entry {
+        GeometryKey Key;
+        int References;
+    };
+    std::map<GeometryKey, ArenaBlock> m_blocks;
+    std::map<ArenaBlock, Entry> m_entries; // By block
+};
+
+#endif
@@ -0,0 +1,47 @@
+//
+//  NullGL.ES1.cpp
+//  ModelViewer
+//
+//  The ES 1.1 entry points ES 2.0 has no equivalent for; the shared ones are
+//  in NullGL.ES2.cpp.
+//
+
+#include <OpenGLES/ES1/gl.h>
+#include <OpenGLES/ES1/glext.h>
+#include "NullGL.hpp"
+
+void glGenFramebuffersOES(GLsizei n, GLuint* framebuffers)
+{
+    for (GLsizei i = 0; i < n; ++i)
+        framebuffers[i] = NullGL::GenerateName();
+}
+
+void glGenRenderbuffersOES(GLsizei n, GLuint* renderbuffers)
+{
+    for (GLsizei i = 0; i < n; ++i)
+        renderbuffers[i] = NullGL::GenerateName();
+}
+
+void glBindFramebufferOES(GLenum target, GLuint framebuffer) {}
+void glBindRenderbufferOES(GLenum target, GLuint renderbuffer) {}
+void glFramebufferRenderbufferOES(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) {}
+void glRenderbufferStorageOES(GLenum target, GLenum internalformat, GLsizei width, GLsizei height) {}
+
+void glGetRenderbufferParameterivOES(GLenum target, GLenum pname, GLint* params)
+{
+    int width, height;
+    NullGL::GetRenderbufferSize(width, height);
+    if (pname == GL_RENDERBUFFER_WIDTH_OES)
+        *params = width;
+    else if (pname == GL_RENDERBUFFER_HEIGHT_OES)
+        *params = height;
+}
+
+void glEnableClientState(GLenum array) {}
+void glVertexPointer(GLint size, GLenum type, GLsizei stride, const void* pointer) {}
+void glNormalPointer(GLenum type, GLsizei stride, const void* pointer) {}
+void glMatrixMode(GLenum mode) {}
+void glLoadMatrixf(const GLfloat* m) {}
+void glLightfv(GLenum light, GLenum pname, const GLfloat* params) {}
+void glMaterialf(GLenum face, GLenum pname, GLfloat param) {}
+void glMaterialfv(GLenum face, GLenum pname, const GLfloat* params) {}
@@ -0,0 +1,104 @@
+//
+//  NullGL.ES2.cpp
+//  ModelViewer
+//
+//  The ES 2.0 entry points, and those ES 1.1 shares with it.
+//
+
+#include <OpenGLES/ES2/gl.h>
+#include <OpenGLES/ES2/glext.h>
+#include "NullGL.hpp"
+
+static void GenerateNames(GLsizei n, GLuint* names)
+{
+    for (GLsizei i = 0; i < n; ++i)
+        names[i] = NullGL::GenerateName();
+}
+
+void glGenBuffers(GLsizei n, GLuint* buffers) { GenerateNames(n, buffers); }
+void glGenFramebuffers(GLsizei n, GLuint* framebuffers) { GenerateNames(n, framebuffers); }
+void glGenRenderbuffers(GLsizei n, GLuint* renderbuffers) { GenerateNames(n, renderbuffers); }
+GLuint glCreateProgram(void) { return NullGL::GenerateName(); }
+GLuint glCreateShader(GLenum type) { return NullGL::GenerateName(); }
+
+void glDeleteBuffers(GLsizei n, const GLuint* buffers) {}
+void glBindBuffer(GLenum target, GLuint buffer) {}
+void glBindFramebuffer(GLenum target, GLuint framebuffer) {}
+void glBindRenderbuffer(GLenum target, GLuint renderbuffer) {}
+void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {}
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {}
+void glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) {}
+void glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height) {}
+
+void glGetRenderbufferParameteriv(GLenum target, GLenum pname, GLint* params)
+{
+    int width, height;
+    NullGL::GetRenderbufferSize(width, height);
+    if (pname == GL_RENDERBUFFER_WIDTH)
+        *params = width;
+    else if (pname == GL_RENDERBUFFER_HEIGHT)
+        *params = height;
+}
+
+const GLubyte* glGetString(GLenum name)
+{
+    return (const GLubyte*) (name == GL_EXTENSIONS ? NullGL::GetExtensions() : "NullGL");
+}
+
+void glShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length) {}
+void glCompileShader(GLuint shader) {}
+void glAttachShader(GLuint program, GLuint shader) {}
+void glLinkProgram(GLuint program) {}
+void glBindAttribLocation(GLuint program, GLuint index, const GLchar* name) {}
+void glUseProgram(GLuint program) {}
+void glGetShaderiv(GLuint shader, GLenum pname, GLint* params) { *params = GL_TRUE; }
+void glGetProgramiv(GLuint program, GLenum pname, GLint* params) { *params = GL_TRUE; }
+
+void glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+    if (bufSize > 0)
+        infoLog[0] = 0;
+    if (length)
+        *length = 0;
+}
+
+void glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+    glGetShaderInfoLog(program, bufSize, length, infoLog);
+}
+
+// A new location for every lookup, as the program only asks once per name
+GLint glGetAttribLocation(GLuint program, const GLchar* name)
+{
+    static GLint lastAttribute = -1;
+    return ++lastAttribute;
+}
+
+GLint glGetUniformLocation(GLuint program, const GLchar* name)
+{
+    static GLint lastUniform = -1;
+    return ++lastUniform;
+}
+
+void glEnableVertexAttribArray(GLuint index) {}
+void glDisableVertexAttribArray(GLuint index) {}
+void glVertexAttribDivisorEXT(GLuint index, GLuint divisor) {}
+void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer) {}
+void glVertexAttrib1f(GLuint index, GLfloat x) {}
+void glVertexAttrib3f(GLuint index, GLfloat x, GLfloat y, GLfloat z) {}
+void glVertexAttrib4fv(GLuint index, const GLfloat* v) {}
+void glUniform1f(GLint location, GLfloat v0) {}
+void glUniform4fv(GLint location, GLsizei count, const GLfloat* value) {}
+void glUniform3fv(GLint location, GLsizei count, const GLfloat* value) {}
+void glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {}
+void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {}
+
+void glEnable(GLenum cap) {}
+void glDisable(GLenum cap) {}
+void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {}
+void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {}
+void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {}
+void glClear(GLbitfield mask) {}
+void glDrawArrays(GLenum mode, GLint first, GLsizei count) {}
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {}
+void glDrawElementsInstancedEXT(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei primcount) {}
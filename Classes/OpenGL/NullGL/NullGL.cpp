@@ -0,0 +1,42 @@
+//
+//  NullGL.cpp
+//  ModelViewer
+//
+
+#include "NullGL.hpp"
+
+namespace NullGL {
+
+static int s_width = 320;
+static int s_height = 480;
+static unsigned int s_lastName = 0;
+static const char* s_extensions = "GL_OES_element_index_uint GL_EXT_instanced_arrays";
+
+void SetRenderbufferSize(int width, int height)
+{
+    s_width = width;
+    s_height = height;
+}
+
+void GetRenderbufferSize(int& width, int& height)
+{
+    width = s_width;
+    height = s_height;
+}
+
+void SetExtensions(const char* extensions)
+{
+    s_extensions = extensions;
+}
+
+const char* GetExtensions()
+{
+    return s_extensions;
+}
+
+unsigned int GenerateName()
+{
+    return ++s_lastName;
+}
+
+}
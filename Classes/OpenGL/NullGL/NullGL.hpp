@@ -0,0 +1,28 @@
+//
+//  NullGL.hpp
+//  ModelViewer
+//
+//  The GL entry points the rendering engines use, doing nothing, so they can
+//  run without a GL context or GPU: on a build machine, in benchmarks, or
+//  with GLTrace to count what a frame submits. Object names count up from 1,
+//  shaders always compile and link, and the renderbuffer has the size set
+//  here. Built from the Khronos ES 1.1 and 2.0 headers.
+//
+
+#ifndef ModelViewer_NullGL_h
+#define ModelViewer_NullGL_h
+
+namespace NullGL {
+
+// What glGetRenderbufferParameteriv reports; 320x480 until set.
+void SetRenderbufferSize(int width, int height);
+void GetRenderbufferSize(int& width, int& height);
+// What glGetString(GL_EXTENSIONS) reports; until set, the extensions of
+// current devices the engines look for.
+void SetExtensions(const char* extensions);
+const char* GetExtensions();
+unsigned int GenerateName();
+
+}
+
+#endif
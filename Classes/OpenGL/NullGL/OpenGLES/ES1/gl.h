@@ -0,0 +1,8 @@
+//
+//  gl.h
+//  ModelViewer
+//
+//  Stands in for the iOS header when building with NullGL on other systems.
+//
+
+#include <GLES/gl.h>
@@ -0,0 +1,9 @@
+//
+//  glext.h
+//  ModelViewer
+//
+//  Stands in for the iOS header when building with NullGL on other systems.
+//
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GLES2/gl2ext.h>
@@ -10,64 +10,145 @@
 #include <OpenGLES/ES1/gl.h>
 #include <OpenGLES/ES1/glext.h>
 #include "Interfaces.hpp"
+#include <cstring>
+#include <algorithm>
 #include "Matrix.hpp"
+#include "MeshSplit.hpp"
+#include "MeshSimplifier.hpp"
+#include "BufferArena.hpp"
+#include "GeometryRegistry.hpp"
+#include "GLTrace.hpp"
 
 namespace ES1 {
     
 struct Drawable {
+    ArenaBlock Vertices;
+    ArenaBlock Indices;
+    vector<LodRange> Lods; // Where each level of detail sits in the index buffer, finest first
+};
+
+// The transforms and color of one visual, worked out once per frame.
+struct VisualState {
+    ivec2 LowerLeft;
+    ivec2 Size;
+    mat4 Projection;
+    mat4 ModelView;
+    vec4 Diffuse;
+};
+
+// One glDrawElements and the state it needs. Commands are sorted by buffers,
+// so draws sharing them run together and bind them once.
+struct DrawCommand {
     GLuint VertexBuffer;
     GLuint IndexBuffer;
-    int IndexCount;
+    size_t VertexOffset;
+    int Visual; // Into the frame's VisualStates
+    size_t FirstIndex; // Byte offset into IndexBuffer
+    GLsizei IndexCount;
+    bool operator<(const DrawCommand& command) const;
+};
+
+// The GL state Render last set, so setting it again to the same value costs
+// nothing; counts the calls made and skipped. It only knows about the calls
+// made through it, so Reset forgets everything at the start of each frame.
+class StateCache {
+public:
+    StateCache();
+    void Reset();
+    void Viewport(ivec2 lowerLeft, ivec2 size);
+    void BindBuffer(GLenum target, GLuint buffer);
+    // Float arrays from the bound array buffer, offset bytes in.
+    void VertexPointer(GLsizei stride, size_t offset);
+    void NormalPointer(GLsizei stride, size_t offset);
+    void LoadMatrix(GLenum mode, const mat4& matrix);
+    // In eye coordinates: loads the identity modelview matrix first.
+    void LightPosition(const vec4& position);
+    void Diffuse(const vec4& color);
+    int GetIssuedCount() const { return m_issued; }
+    int GetElidedCount() const { return m_elided; }
+private:
+    struct ArrayPointer {
+        GLuint Buffer;
+        GLsizei Stride;
+        size_t Offset;
+        bool operator==(const ArrayPointer& pointer) const;
+    };
+    bool IsSet(bool same);
+    void MatrixMode(GLenum mode);
+    ivec2 m_viewportLowerLeft;
+    ivec2 m_viewportSize;
+    GLuint m_arrayBuffer;
+    GLuint m_elementArrayBuffer;
+    ArrayPointer m_vertexPointer;
+    ArrayPointer m_normalPointer;
+    GLenum m_matrixMode;
+    mat4 m_projection;
+    mat4 m_modelView;
+    bool m_hasProjection;
+    bool m_hasModelView;
+    vec4 m_lightPosition;
+    vec4 m_diffuse;
+    bool m_hasLightPosition;
+    bool m_hasDiffuse;
+    int m_issued;
+    int m_elided;
 };
 
 class RenderingEngine : public IRenderingEngine {
 public:
     RenderingEngine();
     void Initialize(const vector<ISurface*>& surfaces);
-    void Render(const vector<Visual>& visuals) const;
+    void Render(const VisualList& visuals) const;
+    void SetSurface(int surfaceIndex, const ISurface& surface);
+    void ReleaseSurface(int surfaceIndex);
+    size_t GetSurfaceBytes(int surfaceIndex) const;
+    RenderStats GetRenderStats() const { return m_stats; }
 private:
-    vector<Drawable> m_drawables;
+    void BuildCommands(const VisualList& visuals) const;
+    void ExecuteCommands() const;
+    void CreateDrawables(const ISurface& surface, vector<Drawable>& drawables);
+    void ReleaseDrawables(const vector<Drawable>& drawables);
+    void CreateLargeDrawables(const ISurface& surface, vector<Drawable>& drawables);
+    ArenaBlock AcquireBlock(GLenum target, GLsizeiptr size, const GLvoid* data);
+    BufferArena& GetArena(GLenum target);
+    GLuint CreateBuffer(GLenum target, GLsizeiptr size, const GLvoid* data) const;
+    vector< vector<Drawable> > m_drawables; // The draw calls making up each surface
+    vector<size_t> m_surfaceBytes; // What each surface's drawables asked of the arenas
+    size_t m_acquiredBytes; // Asked of AcquireBlock so far, shared blocks included
+    BufferArena m_vertexArena; // Every surface's vertices, packed into as few buffers as fit
+    BufferArena m_indexArena;
+    GeometryRegistry m_geometry; // The blocks of both arenas, shared between drawables with the same data
     GLuint m_colorRenderbuffer;
     GLuint m_depthRenderbuffer;
     mat4 m_translation;
+    
+    // Per-frame state, kept between frames so its memory is reused
+    mutable vector<VisualState> m_visualStates;
+    mutable vector<DrawCommand> m_commands;
+    mutable StateCache m_state;
+    mutable RenderStats m_stats;
 };
 
 IRenderingEngine * CreateRenderingEngine() {
     return new RenderingEngine();
 }
 
-RenderingEngine::RenderingEngine() {
+RenderingEngine::RenderingEngine() : m_acquiredBytes(0) {
     glGenRenderbuffersOES(1, &m_colorRenderbuffer);
     glBindRenderbufferOES(GL_RENDERBUFFER_OES, m_colorRenderbuffer);
+    RenderStats none = {};
+    m_stats = none;
 }
 
 void RenderingEngine::Initialize(const vector<ISurface *> &surfaces) {
     glEnable(GL_DEPTH_TEST);
 
-    vector<ISurface *>::const_iterator surface;
-    for (surface = surfaces.begin(); surface != surfaces.end(); ++surface) {
-        // Create VBO for vertices
-        vector<float> vertices;
-        (*surface)->GenerateVertices(vertices, VertexFlagsNormal);
-        GLuint vertexBuffer;
-        glGenBuffers(1, &vertexBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), &vertices[0], GL_STATIC_DRAW);
-        
-        // create VBO for indices (if needed)
-        int indexCount = (*surface)->GetTriangleIndexCount();
-        GLuint indexBuffer;
-        if (!m_drawables.empty() && indexCount == m_drawables[0].IndexCount) {
-            indexBuffer = m_drawables[0].IndexBuffer;
-        } else {
-            vector<GLushort> indices(indexCount);
-            (*surface)->GenerateTriangleIndices(indices);
-            glGenBuffers(1, &indexBuffer);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), &indices[0], GL_STATIC_DRAW);
-        }
-        Drawable drawable = { vertexBuffer, indexBuffer, indexCount };
-        m_drawables.push_back(drawable);
+    m_drawables.resize(surfaces.size());
+    m_surfaceBytes.resize(surfaces.size());
+    for (size_t surfaceIndex = 0; surfaceIndex < surfaces.size(); ++surfaceIndex) {
+        size_t acquired = m_acquiredBytes;
+        CreateDrawables(*surfaces[surfaceIndex], m_drawables[surfaceIndex]);
+        m_surfaceBytes[surfaceIndex] = m_acquiredBytes - acquired;
     }
     
     // Depth Buffer
@@ -101,49 +182,314 @@ void RenderingEngine::Initialize(const vector<ISurface *> &surfaces) {
     m_translation = mat4::Translate(0, 0, -7);
 }
     
-void RenderingEngine::Render(const vector<Visual>& visuals) const {
+void RenderingEngine::CreateDrawables(const ISurface& surface, vector<Drawable>& drawables) {
+    // Surfaces too big for 16-bit indices get their own path
+    if (surface.GetVertexCount() > MaxShortIndexVertices) {
+        CreateLargeDrawables(surface, drawables);
+        return;
+    }
+    
+    // Create VBO for vertices, straight from the surface's buffer when it has one
+    vector<float> vertices;
+    const float* vertexData = surface.GetVertexData();
+    if (!vertexData) {
+        surface.GenerateVertices(vertices, VertexFlagsNormal);
+        vertexData = &vertices[0];
+    }
+    GLsizeiptr vertexSize = surface.GetVertexCount() * sizeof(vec3) * 2;
+    ArenaBlock vertexBlock = AcquireBlock(GL_ARRAY_BUFFER, vertexSize, vertexData);
+    
+    // create VBO for indices, holding every level of detail
+    Drawable drawable = { vertexBlock };
+    GetLodRanges(surface, drawable.Lods);
+    const LodRange& last = drawable.Lods.back();
+    int indexCount = last.FirstIndex + last.IndexCount;
+    vector<GLushort> indices;
+    const GLushort* indexData = surface.GetTriangleIndexData();
+    if (!indexData) {
+        GenerateLodTriangleIndices(surface, indices);
+        indexData = &indices[0];
+    }
+    drawable.Indices = AcquireBlock(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indexData);
+    drawables.push_back(drawable);
+}
+
+void RenderingEngine::SetSurface(int surfaceIndex, const ISurface& surface) {
+    if (surfaceIndex >= (int) m_drawables.size()) {
+        m_drawables.resize(surfaceIndex + 1);
+        m_surfaceBytes.resize(surfaceIndex + 1);
+    }
+    
+    // Acquire the new buffers first, so those shared with the old surface stay alive
+    vector<Drawable> drawables;
+    size_t acquired = m_acquiredBytes;
+    CreateDrawables(surface, drawables);
+    m_surfaceBytes[surfaceIndex] = m_acquiredBytes - acquired;
+    m_drawables[surfaceIndex].swap(drawables);
+    ReleaseDrawables(drawables);
+}
+
+void RenderingEngine::ReleaseSurface(int surfaceIndex) {
+    ReleaseDrawables(m_drawables[surfaceIndex]);
+    vector<Drawable>().swap(m_drawables[surfaceIndex]);
+    m_surfaceBytes[surfaceIndex] = 0;
+}
+
+size_t RenderingEngine::GetSurfaceBytes(int surfaceIndex) const {
+    return surfaceIndex < (int) m_surfaceBytes.size() ? m_surfaceBytes[surfaceIndex] : 0;
+}
+
+void RenderingEngine::ReleaseDrawables(const vector<Drawable>& drawables) {
+    for (vector<Drawable>::const_iterator drawable = drawables.begin(); drawable != drawables.end(); ++drawable) {
+        if (m_geometry.Release(drawable->Vertices) && m_vertexArena.Free(drawable->Vertices))
+            glDeleteBuffers(1, &drawable->Vertices.Buffer);
+        if (m_geometry.Release(drawable->Indices) && m_indexArena.Free(drawable->Indices))
+            glDeleteBuffers(1, &drawable->Indices.Buffer);
+    }
+}
+
+void RenderingEngine::CreateLargeDrawables(const ISurface& surface, vector<Drawable>& drawables) {
+    vector<float> vertices;
+    const float* vertexData = surface.GetVertexData();
+    if (!vertexData) {
+        surface.GenerateVertices(vertices, VertexFlagsNormal);
+        vertexData = &vertices[0];
+    }
+    vector<GLuint> indices;
+    surface.GenerateTriangleIndices(indices);
+    
+    // ES1 only draws with 16-bit indices, so split the surface into small enough
+    // sub-meshes, drawn at full detail only
+    vector<SubMesh> subMeshes;
+    SplitMesh(indices, surface.GetVertexCount(), subMeshes);
+    for (vector<SubMesh>::const_iterator subMesh = subMeshes.begin(); subMesh != subMeshes.end(); ++subMesh) {
+        vector<float> subMeshVertices;
+        GatherSubMeshVertices(*subMesh, vertexData, 6, subMeshVertices);
+        ArenaBlock vertexBlock = AcquireBlock(GL_ARRAY_BUFFER, subMeshVertices.size() * sizeof(float), &subMeshVertices[0]);
+        const vector<GLushort>& subMeshIndices = subMesh->Indices;
+        ArenaBlock indexBlock = AcquireBlock(GL_ELEMENT_ARRAY_BUFFER, subMeshIndices.size() * sizeof(GLushort), &subMeshIndices[0]);
+        Drawable drawable = { vertexBlock, indexBlock };
+        LodRange range = { 0, (int) subMeshIndices.size() };
+        drawable.Lods.push_back(range);
+        drawables.push_back(drawable);
+    }
+}
+
+ArenaBlock RenderingEngine::AcquireBlock(GLenum target, GLsizeiptr size, const GLvoid* data) {
+    m_acquiredBytes += size;
+    GeometryKey key = GeometryRegistry::MakeKey(target, data, size);
+    ArenaBlock block;
+    if (m_geometry.Acquire(key, block))
+        return block;
+    
+    // Copy the data into the arena, adding a buffer to it when none has room
+    BufferArena& arena = GetArena(target);
+    if (!arena.Allocate(size, block)) {
+        GLsizeiptr pageSize = arena.GetNewPageSize(size);
+        arena.AddPage(CreateBuffer(target, pageSize, 0), pageSize);
+        arena.Allocate(size, block);
+    }
+    glBindBuffer(target, block.Buffer);
+    glBufferSubData(target, block.Offset, size, data);
+    m_geometry.Insert(key, block);
+    return block;
+}
+
+BufferArena& RenderingEngine::GetArena(GLenum target) {
+    return target == GL_ARRAY_BUFFER ? m_vertexArena : m_indexArena;
+}
+
+GLuint RenderingEngine::CreateBuffer(GLenum target, GLsizeiptr size, const GLvoid* data) const {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    return buffer;
+}
+
+void RenderingEngine::Render(const VisualList& visuals) const {
     glClearColor(0.5f, 0.5f, 0.5f, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    vector<Visual>::const_iterator visual = visuals.begin();
-    for (int visualIndex = 0; visual != visuals.end(); ++visual, ++visualIndex) {
-        
-        // Viewport Transform
-        ivec2 size = visual->ViewportSize;
-        ivec2 lowerLeft = visual->LowerLeft;
-        glViewport(lowerLeft.x, lowerLeft.y, size.x, size.y);
+    BuildCommands(visuals);
+    ExecuteCommands();
+}
+
+void RenderingEngine::BuildCommands(const VisualList& visuals) const {
+    m_visualStates.resize(visuals.Count);
+    m_commands.clear();
+    ivec2 projectionSize(0, 0);
+    mat4 projection;
+    for (int visualIndex = 0; visualIndex < visuals.Count; ++visualIndex) {
+        const Visual& visual = visuals[visualIndex];
+        VisualState& state = m_visualStates[visualIndex];
         
-        // Set light position
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        vec4 lightPosition(0.25, 0.25, 1, 0);
-        glLightfv(GL_LIGHT0, GL_POSITION, lightPosition.Pointer());
+        // Viewport and Projection Transform, reused while the size stays the same
+        ivec2 size = visual.ViewportSize;
+        if (!(size == projectionSize)) {
+            float h = 4.0 * size.y / size.x;
+            projection = mat4::Frustum(-2, 2, -h/2, h/2, 5, 10);
+            projectionSize = size;
+        }
+        state.LowerLeft = visual.LowerLeft;
+        state.Size = size;
+        state.Projection = projection;
         
         // Modelview Transform
-        mat4 rotation = visual->Orientation.ToMatrix();
-        mat4 modelView = rotation * m_translation;
-        glLoadMatrixf(modelView.Pointer());
+        mat4 rotation = visual.Orientation.ToMatrix();
+        state.ModelView = rotation * mat4::Translate(visual.Position) * m_translation;
         
-        // Projection Transform
-        float h = 4.0 * size.y / size.x;
-        mat4 projection = mat4::Frustum(-2, 2, -h/2, h/2, 5, 10);
-        glMatrixMode(GL_PROJECTION);
-        glLoadMatrixf(projection.Pointer());
+        // diffuse color
+        vec3 color = visual.Color * 0.75;
+        state.Diffuse = vec4(color, 1);
         
-        // set diffuse color
-        vec3 color = visual->Color * 0.75;
-        vec4 diffuse(color.x, color.y, color.z, 1);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse.Pointer());
+        // A draw per drawable of the surface, at the level of detail its viewport calls for
+        const vector<Drawable>& drawables = m_drawables[visual.Surface];
+        for (vector<Drawable>::const_iterator drawable = drawables.begin(); drawable != drawables.end(); ++drawable) {
+            const LodRange& lod = drawable->Lods[ChooseLod(drawable->Lods, size)];
+            DrawCommand command = {
+                drawable->Vertices.Buffer, drawable->Indices.Buffer, drawable->Vertices.Offset, visualIndex,
+                drawable->Indices.Offset + lod.FirstIndex * sizeof(GLushort), lod.IndexCount
+            };
+            m_commands.push_back(command);
+        }
+    }
+    std::sort(m_commands.begin(), m_commands.end());
+}
+
+void RenderingEngine::ExecuteCommands() const {
+    m_state.Reset();
+    m_state.LightPosition(vec4(0.25, 0.25, 1, 0));
+    int stride = sizeof(vec3) * 2;
+    for (vector<DrawCommand>::const_iterator command = m_commands.begin(); command != m_commands.end(); ++command) {
+        const VisualState& visual = m_visualStates[command->Visual];
+        m_state.Viewport(visual.LowerLeft, visual.Size);
+        m_state.LoadMatrix(GL_PROJECTION, visual.Projection);
+        m_state.LoadMatrix(GL_MODELVIEW, visual.ModelView);
+        m_state.Diffuse(visual.Diffuse);
         
-        // Draw the surface
-        int stride = sizeof(vec3) * 2;
-        const Drawable& drawable = m_drawables[visualIndex];
-        glBindBuffer(GL_ARRAY_BUFFER, drawable.VertexBuffer);
-        glVertexPointer(3, GL_FLOAT, stride, 0);
-        const GLvoid * normalOffset = (const GLvoid *)sizeof(vec3);
-        glNormalPointer(GL_FLOAT, stride, normalOffset);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable.IndexBuffer);
-        glDrawElements(GL_TRIANGLES, drawable.IndexCount, GL_UNSIGNED_SHORT, 0);
+        // ES 1.1 has no base vertex, so the pointers aim at the draw's vertices
+        m_state.BindBuffer(GL_ARRAY_BUFFER, command->VertexBuffer);
+        m_state.VertexPointer(stride, command->VertexOffset);
+        m_state.NormalPointer(stride, command->VertexOffset + sizeof(vec3));
+        m_state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, command->IndexBuffer);
+        glDrawElements(GL_TRIANGLES, command->IndexCount, GL_UNSIGNED_SHORT, (const GLvoid *) command->FirstIndex);
     }
+    m_stats.DrawCalls = m_commands.size();
+    m_stats.StateCallsIssued = m_state.GetIssuedCount();
+    m_stats.StateCallsElided = m_state.GetElidedCount();
+    m_stats.Calls = GLTrace::TakeCounts();
+}
+
+bool DrawCommand::operator<(const DrawCommand& command) const {
+    if (VertexBuffer != command.VertexBuffer)
+        return VertexBuffer < command.VertexBuffer;
+    if (IndexBuffer != command.IndexBuffer)
+        return IndexBuffer < command.IndexBuffer;
+    if (VertexOffset != command.VertexOffset)
+        return VertexOffset < command.VertexOffset;
+    if (Visual != command.Visual)
+        return Visual < command.Visual;
+    return FirstIndex < command.FirstIndex;
+}
+
+StateCache::StateCache() {
+    Reset();
+}
+
+void StateCache::Reset() {
+    m_viewportLowerLeft = ivec2(0, 0);
+    m_viewportSize = ivec2(-1, -1);
+    m_arrayBuffer = 0;
+    m_elementArrayBuffer = 0;
+    ArrayPointer none = { 0, 0, 0 };
+    m_vertexPointer = none;
+    m_normalPointer = none;
+    m_matrixMode = 0;
+    m_hasProjection = false;
+    m_hasModelView = false;
+    m_hasLightPosition = false;
+    m_hasDiffuse = false;
+    m_issued = 0;
+    m_elided = 0;
+}
+
+bool StateCache::ArrayPointer::operator==(const ArrayPointer& pointer) const {
+    return Buffer == pointer.Buffer && Stride == pointer.Stride && Offset == pointer.Offset;
+}
+
+bool StateCache::IsSet(bool same) {
+    if (same)
+        ++m_elided;
+    else
+        ++m_issued;
+    return same;
+}
+
+void StateCache::Viewport(ivec2 lowerLeft, ivec2 size) {
+    if (IsSet(lowerLeft == m_viewportLowerLeft && size == m_viewportSize))
+        return;
+    glViewport(lowerLeft.x, lowerLeft.y, size.x, size.y);
+    m_viewportLowerLeft = lowerLeft;
+    m_viewportSize = size;
+}
+
+void StateCache::BindBuffer(GLenum target, GLuint buffer) {
+    GLuint& bound = target == GL_ARRAY_BUFFER ? m_arrayBuffer : m_elementArrayBuffer;
+    if (IsSet(buffer == bound))
+        return;
+    glBindBuffer(target, buffer);
+    bound = buffer;
+}
+
+void StateCache::VertexPointer(GLsizei stride, size_t offset) {
+    ArrayPointer pointer = { m_arrayBuffer, stride, offset };
+    if (IsSet(pointer.Buffer != 0 && pointer == m_vertexPointer))
+        return;
+    glVertexPointer(3, GL_FLOAT, stride, (const GLubyte *) 0 + offset);
+    m_vertexPointer = pointer;
+}
+
+void StateCache::NormalPointer(GLsizei stride, size_t offset) {
+    ArrayPointer pointer = { m_arrayBuffer, stride, offset };
+    if (IsSet(pointer.Buffer != 0 && pointer == m_normalPointer))
+        return;
+    glNormalPointer(GL_FLOAT, stride, (const GLubyte *) 0 + offset);
+    m_normalPointer = pointer;
+}
+
+void StateCache::MatrixMode(GLenum mode) {
+    if (IsSet(mode == m_matrixMode))
+        return;
+    glMatrixMode(mode);
+    m_matrixMode = mode;
+}
+
+void StateCache::LoadMatrix(GLenum mode, const mat4& matrix) {
+    mat4& loaded = mode == GL_PROJECTION ? m_projection : m_modelView;
+    bool& hasLoaded = mode == GL_PROJECTION ? m_hasProjection : m_hasModelView;
+    if (IsSet(hasLoaded && memcmp(&loaded, &matrix, sizeof(mat4)) == 0))
+        return;
+    MatrixMode(mode);
+    glLoadMatrixf(matrix.Pointer());
+    loaded = matrix;
+    hasLoaded = true;
+}
+
+void StateCache::LightPosition(const vec4& position) {
+    if (IsSet(m_hasLightPosition && memcmp(&m_lightPosition, &position, sizeof(vec4)) == 0))
+        return;
+    LoadMatrix(GL_MODELVIEW, mat4::Identity());
+    glLightfv(GL_LIGHT0, GL_POSITION, position.Pointer());
+    m_lightPosition = position;
+    m_hasLightPosition = true;
+}
+
+void StateCache::Diffuse(const vec4& color) {
+    if (IsSet(m_hasDiffuse && memcmp(&m_diffuse, &color, sizeof(vec4)) == 0))
+        return;
+    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, color.Pointer());
+    m_diffuse = color;
+    m_hasDiffuse = true;
 }
     
 }
\ No newline at end of file
@@ -10,12 +10,24 @@
 #include <OpenGLES/ES2/gl.h>
 #include <OpenGLES/ES2/glext.h>
 #include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
 #include "Interfaces.hpp"
 #include "Matrix.hpp"
+#include "MeshSplit.hpp"
+#include "MeshSimplifier.hpp"
+#include "VertexCompression.hpp"
+#include "BufferArena.hpp"
+#include "GeometryRegistry.hpp"
+#include "GLTrace.hpp"
 
 #define STRINGIFY(A) #A
 #include "../../Shaders/PixelLighting.vert"
 #include "../../Shaders/PixelLighting.frag"
+#include "../../Shaders/CompactPixelLighting.vert"
+#include "../../Shaders/InstancedPixelLighting.vert"
+#include "../../Shaders/BatchedPixelLighting.vert"
 
 struct UniformHandles {
     GLuint ModelView;
@@ -25,6 +37,9 @@ struct UniformHandles {
     GLint Ambient;
     GLint Specular;
     GLint Shininess;
+    GLint InstanceModelview; // With BatchedVertexShader
+    GLint InstanceDiffuse;
+    GLint InstanceIndex;
 };
 
 struct AttributeHandles {
@@ -34,71 +49,224 @@ struct AttributeHandles {
 };
 
 namespace ES2 {
+
+// Bound before linking, so every program finds its attributes in the same
+// place and the arrays enabled for one carry over to the others.
+enum AttributeLocation {
+    PositionAttribute,
+    NormalAttribute,
+    DiffuseAttribute,
+    InstanceModelviewAttribute, // A column each, in it and the three after
+    InstanceDiffuseAttribute = InstanceModelviewAttribute + 4,
+};
+
+// How draws of the same drawable in the same viewport are batched: with
+// GL_EXT_instanced_arrays, one instanced draw taking each instance's modelview
+// and color from a vertex stream; without it, by uploading the instances to
+// uniform arrays UniformBatchSize at a time, each draw then only setting an
+// index. Compact vertices are drawn one by one.
+enum InstancingMode {
+    InstancingNone,
+    InstancingArrays,
+    InstancingUniforms,
+};
+
+const int UniformBatchSize = 16; // As declared in BatchedVertexShader
     
 struct Drawable {
+    ArenaBlock Vertices;
+    ArenaBlock Indices;
+    GLenum IndexType;
+    vector<LodRange> Lods; // Where each level of detail sits in the index buffer, finest first
+    mat4 Dequantize; // For compact vertices, from quantized to surface coordinates
+};
+
+// The transforms and color of one visual, worked out once per frame.
+struct VisualState {
+    ivec2 LowerLeft;
+    ivec2 Size;
+    mat4 Projection;
+    mat4 ModelView;
+    mat3 NormalMatrix;
+    vec4 Diffuse;
+};
+
+// One glDrawElements and the state it needs. Commands are sorted by program,
+// then buffers, so draws sharing them run together and set them once.
+struct DrawCommand {
+    GLuint Program;
     GLuint VertexBuffer;
     GLuint IndexBuffer;
-    int IndexCount;
+    size_t VertexOffset;
+    size_t FirstIndex; // Byte offset into IndexBuffer
+    GLsizei IndexCount;
+    GLenum IndexType;
+    const mat4* Dequantize; // Null for float vertices
+    int Viewport; // Shared by visuals in a row with the same viewport
+    int Visual; // Into the frame's VisualStates
+    bool operator<(const DrawCommand& command) const;
+    // Whether the two only differ by their visual, and could be instanced.
+    bool IsInstanceOf(const DrawCommand& command) const;
+};
+
+// A run of sorted commands drawing the same thing for different visuals.
+struct DrawBatch {
+    int FirstCommand;
+    int CommandCount;
+    int FirstInstance; // Into the frame's instance streams, -1 to draw the commands one by one
+};
+
+// The GL state Render last set, so setting it again to the same value costs
+// nothing; counts the calls made and skipped. It only knows about the calls
+// made through it, so Reset forgets everything at the start of each frame.
+class StateCache {
+public:
+    StateCache();
+    void Reset();
+    void UseProgram(GLuint program);
+    void Viewport(ivec2 lowerLeft, ivec2 size);
+    void BindBuffer(GLenum target, GLuint buffer);
+    // Unnormalized attribute from the bound array buffer, offset bytes in.
+    void VertexAttribPointer(GLuint index, GLint size, GLenum type, GLsizei stride, size_t offset);
+    void VertexAttrib(GLuint index, const vec4& value);
+    void Uniform(GLint location, const vec3& value);
+    void Uniform(GLint location, const mat3& value);
+    void Uniform(GLint location, const mat4& value);
+    int GetIssuedCount() const { return m_issued; }
+    int GetElidedCount() const { return m_elided; }
+private:
+    enum { MaxAttributes = 8, MaxUniforms = 8 };
+    struct AttributePointer {
+        GLuint Buffer;
+        GLint Size;
+        GLenum Type;
+        GLsizei Stride;
+        size_t Offset;
+    };
+    struct UniformValue {
+        GLint Location;
+        int Count;
+        float Values[16];
+    };
+    bool IsSet(bool same);
+    bool IsUniformSet(GLint location, const float* values, int count);
+    GLuint m_program;
+    ivec2 m_viewportLowerLeft;
+    ivec2 m_viewportSize;
+    GLuint m_arrayBuffer;
+    GLuint m_elementArrayBuffer;
+    AttributePointer m_pointers[MaxAttributes];
+    vec4 m_attributes[MaxAttributes];
+    bool m_hasAttribute[MaxAttributes];
+    UniformValue m_uniforms[MaxUniforms];
+    int m_uniformCount;
+    int m_issued;
+    int m_elided;
 };
 
 class RenderingEngine : public IRenderingEngine {
 public:
-    RenderingEngine();
+    RenderingEngine(VertexFormat vertexFormat, RedrawMode redrawMode);
     void Initialize(const vector<ISurface*>& surfaces);
-    void Render(const vector<Visual>& visuals) const;
+    void Render(const VisualList& visuals) const;
+    void SetSurface(int surfaceIndex, const ISurface& surface);
+    void ReleaseSurface(int surfaceIndex);
+    size_t GetSurfaceBytes(int surfaceIndex) const;
+    RenderStats GetRenderStats() const { return m_stats; }
 private:
+    void FindDamage(const VisualList& visuals, ivec2& lowerLeft, ivec2& size) const;
+    void BuildCommands(const VisualList& visuals) const;
+    void BuildBatches() const;
+    void ExecuteCommands() const;
+    void Draw(const DrawCommand& command) const;
+    void DrawInstanced(const DrawBatch& batch) const;
+    void DrawBatched(const DrawBatch& batch) const;
+    void BindGeometry(const DrawCommand& command) const;
+    void EnableInstanceArrays(bool enabled) const;
+    void GetUniformHandles(GLuint program, UniformHandles& uniforms) const;
+    void CreateDrawables(const ISurface& surface, vector<Drawable>& drawables);
+    void ReleaseDrawables(const vector<Drawable>& drawables);
     GLuint BuildProgram(const char* vertexShaderSource, const char* fragmentShaderSource) const;
     GLuint BuildShader(const char* source, GLenum shaderType) const;
-    vector<Drawable> m_drawables;
+    void CreateLargeDrawables(const ISurface& surface, vector<Drawable>& drawables);
+    ArenaBlock AcquireVertices(const float* vertexData, int vertexCount, mat4& dequantize);
+    ArenaBlock AcquireBlock(GLenum target, GLsizeiptr size, const GLvoid* data);
+    BufferArena& GetArena(GLenum target);
+    GLuint CreateBuffer(GLenum target, GLsizeiptr size, const GLvoid* data) const;
+    vector< vector<Drawable> > m_drawables; // The draw calls making up each surface
+    vector<size_t> m_surfaceBytes; // What each surface's drawables asked of the arenas
+    size_t m_acquiredBytes; // Asked of AcquireBlock so far, shared blocks included
+    BufferArena m_vertexArena; // Every surface's vertices, packed into as few buffers as fit
+    BufferArena m_indexArena;
+    GeometryRegistry m_geometry; // The blocks of both arenas, shared between drawables with the same data
     GLuint m_colorRenderbuffer;
     GLuint m_depthRenderbuffer;
     mat4 m_translation;
     UniformHandles m_uniforms;
     AttributeHandles m_attributes;
+    bool m_hasUintIndices;
+    VertexFormat m_vertexFormat;
+    RedrawMode m_redrawMode;
+    ivec2 m_framebufferSize;
+    GLuint m_program;
+    InstancingMode m_instancing;
+    GLuint m_batchProgram; // Drawing instances, the way m_instancing says
+    UniformHandles m_batchUniforms;
+    GLuint m_instanceBuffer; // The instance streams, with InstancingArrays
+    
+    // Per-frame state, kept between frames so its memory is reused
+    mutable vector<VisualState> m_visualStates;
+    mutable vector<bool> m_redrawVisuals; // Whether each visual is drawn this frame
+    mutable vector<Visual> m_previousVisuals; // As last drawn, to find what changed
+    mutable vector<bool> m_changedSurfaces; // Swapped since the last frame
+    mutable vector<DrawCommand> m_commands;
+    mutable vector<DrawBatch> m_batches;
+    mutable vector<mat4> m_instanceModelviews; // Of the batched commands' visuals, in order
+    mutable vector<vec4> m_instanceColors;
+    mutable StateCache m_state;
+    mutable RenderStats m_stats;
 };
 
-IRenderingEngine * CreateRenderingEngine() {
-    return new RenderingEngine();
+IRenderingEngine * CreateRenderingEngine(VertexFormat vertexFormat, RedrawMode redrawMode) {
+    return new RenderingEngine(vertexFormat, redrawMode);
 }
 
-RenderingEngine::RenderingEngine() {
+RenderingEngine::RenderingEngine(VertexFormat vertexFormat, RedrawMode redrawMode) :
+    m_acquiredBytes(0), m_vertexFormat(vertexFormat), m_redrawMode(redrawMode), m_instancing(InstancingNone),
+    m_batchProgram(0), m_instanceBuffer(0) {
     glGenRenderbuffers(1, &m_colorRenderbuffer);
     glBindRenderbuffer(GL_RENDERBUFFER, m_colorRenderbuffer);
+    RenderStats none = {};
+    m_stats = none;
 }
 
 void RenderingEngine::Initialize(const vector<ISurface *> &surfaces) {
     glEnable(GL_DEPTH_TEST);
     
-    vector<ISurface *>::const_iterator surface;
-    for (surface = surfaces.begin(); surface != surfaces.end(); ++surface) {
-        // Create VBO for vertices
-        vector<float> vertices;
-        (*surface)->GenerateVertices(vertices, VertexFlagsNormal);
-        GLuint vertexBuffer;
-        glGenBuffers(1, &vertexBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), &vertices[0], GL_STATIC_DRAW);
-        
-        // create VBO for indices (if needed)
-        int indexCount = (*surface)->GetTriangleIndexCount();
-        GLuint indexBuffer;
-        if (!m_drawables.empty() && indexCount == m_drawables[0].IndexCount) {
-            indexBuffer = m_drawables[0].IndexBuffer;
-        } else {
-            vector<GLushort> indices(indexCount);
-            (*surface)->GenerateTriangleIndices(indices);
-            glGenBuffers(1, &indexBuffer);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), &indices[0], GL_STATIC_DRAW);
-        }
-        Drawable drawable = { vertexBuffer, indexBuffer, indexCount };
-        m_drawables.push_back(drawable);
+    const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+    m_hasUintIndices = extensions && strstr(extensions, "GL_OES_element_index_uint");
+    if (m_vertexFormat == VertexFormatCompact) {
+        m_instancing = InstancingNone;
+    } else if (extensions && strstr(extensions, "GL_EXT_instanced_arrays")) {
+        m_instancing = InstancingArrays;
+    } else {
+        m_instancing = InstancingUniforms;
+    }
+    
+    m_drawables.resize(surfaces.size());
+    m_surfaceBytes.resize(surfaces.size());
+    m_changedSurfaces.assign(surfaces.size(), true);
+    for (size_t surfaceIndex = 0; surfaceIndex < surfaces.size(); ++surfaceIndex) {
+        size_t acquired = m_acquiredBytes;
+        CreateDrawables(*surfaces[surfaceIndex], m_drawables[surfaceIndex]);
+        m_surfaceBytes[surfaceIndex] = m_acquiredBytes - acquired;
     }
     
     // Depth Buffer
     int width, height;
     glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
     glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+    m_framebufferSize = ivec2(width, height);
     
     glGenRenderbuffers(1, &m_depthRenderbuffer);
     glBindRenderbuffer(GL_RENDERBUFFER, m_depthRenderbuffer);
@@ -112,20 +280,26 @@ void RenderingEngine::Initialize(const vector<ISurface *> &surfaces) {
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRenderbuffer);
     glBindRenderbuffer(GL_RENDERBUFFER, m_colorRenderbuffer);
     
-    GLuint program = BuildProgram(SimpleVertexShader, SimpleFragmentShader);
-    glUseProgram(program);
+    bool isCompact = m_vertexFormat == VertexFormatCompact;
+    if (m_instancing != InstancingNone) {
+        bool isInstanced = m_instancing == InstancingArrays;
+        m_batchProgram = BuildProgram(isInstanced ? InstancedVertexShader : BatchedVertexShader, SimpleFragmentShader);
+        GetUniformHandles(m_batchProgram, m_batchUniforms);
+    }
+    if (m_instancing == InstancingArrays) {
+        glGenBuffers(1, &m_instanceBuffer);
+        for (GLuint attribute = InstanceModelviewAttribute; attribute <= InstanceDiffuseAttribute; ++attribute)
+            glVertexAttribDivisorEXT(attribute, 1);
+    }
     
-    m_attributes.Position = glGetAttribLocation(program, "Position");
-    m_attributes.Normal = glGetAttribLocation(program, "Normal");
-    m_attributes.Diffuse = glGetAttribLocation(program, "DiffuseMaterial");
+    GLuint program = BuildProgram(isCompact ? CompactVertexShader : SimpleVertexShader, SimpleFragmentShader);
+    glUseProgram(program);
+    m_program = program;
     
-    m_uniforms.Projection = glGetUniformLocation(program, "Projection");
-    m_uniforms.ModelView = glGetUniformLocation(program, "Modelview");
-    m_uniforms.NormalMatrix = glGetUniformLocation(program, "NormalMatrix");
-    m_uniforms.LightPosition = glGetUniformLocation(program, "LightPosition");
-    m_uniforms.Ambient = glGetUniformLocation(program, "AmbientMaterial");
-    m_uniforms.Specular = glGetUniformLocation(program, "SpecularMaterial");
-    m_uniforms.Shininess = glGetUniformLocation(program, "Shininess");
+    m_attributes.Position = PositionAttribute;
+    m_attributes.Normal = NormalAttribute;
+    m_attributes.Diffuse = DiffuseAttribute;
+    GetUniformHandles(program, m_uniforms);
     
     // some default material parameters
     glVertexAttrib3f(m_uniforms.Ambient, 0.04, 0.04, 0.04);
@@ -138,51 +312,450 @@ void RenderingEngine::Initialize(const vector<ISurface *> &surfaces) {
     m_translation = mat4::Translate(0, 0, -7);
 }
 
-void RenderingEngine::Render(const vector<Visual>& visuals) const {
+void RenderingEngine::GetUniformHandles(GLuint program, UniformHandles& uniforms) const {
+    uniforms.Projection = glGetUniformLocation(program, "Projection");
+    uniforms.ModelView = glGetUniformLocation(program, "Modelview");
+    uniforms.NormalMatrix = glGetUniformLocation(program, "NormalMatrix");
+    uniforms.LightPosition = glGetUniformLocation(program, "LightPosition");
+    uniforms.Ambient = glGetUniformLocation(program, "AmbientMaterial");
+    uniforms.Specular = glGetUniformLocation(program, "SpecularMaterial");
+    uniforms.Shininess = glGetUniformLocation(program, "Shininess");
+    uniforms.InstanceModelview = glGetUniformLocation(program, "InstanceModelview");
+    uniforms.InstanceDiffuse = glGetUniformLocation(program, "InstanceDiffuse");
+    uniforms.InstanceIndex = glGetUniformLocation(program, "InstanceIndex");
+}
+
+void RenderingEngine::CreateDrawables(const ISurface& surface, vector<Drawable>& drawables) {
+    // Surfaces too big for 16-bit indices get their own path
+    if (surface.GetVertexCount() > MaxShortIndexVertices) {
+        CreateLargeDrawables(surface, drawables);
+        return;
+    }
+    
+    // Create VBO for vertices, straight from the surface's buffer when it has one
+    vector<float> vertices;
+    const float* vertexData = surface.GetVertexData();
+    if (!vertexData) {
+        surface.GenerateVertices(vertices, VertexFlagsNormal);
+        vertexData = &vertices[0];
+    }
+    mat4 dequantize;
+    ArenaBlock vertexBlock = AcquireVertices(vertexData, surface.GetVertexCount(), dequantize);
+    
+    // create VBO for indices, holding every level of detail
+    Drawable drawable = { vertexBlock, ArenaBlock(), GL_UNSIGNED_SHORT };
+    drawable.Dequantize = dequantize;
+    GetLodRanges(surface, drawable.Lods);
+    const LodRange& last = drawable.Lods.back();
+    int indexCount = last.FirstIndex + last.IndexCount;
+    vector<GLushort> indices;
+    const GLushort* indexData = surface.GetTriangleIndexData();
+    if (!indexData) {
+        GenerateLodTriangleIndices(surface, indices);
+        indexData = &indices[0];
+    }
+    drawable.Indices = AcquireBlock(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indexData);
+    drawables.push_back(drawable);
+}
+
+void RenderingEngine::SetSurface(int surfaceIndex, const ISurface& surface) {
+    if (surfaceIndex >= (int) m_drawables.size()) {
+        m_drawables.resize(surfaceIndex + 1);
+        m_surfaceBytes.resize(surfaceIndex + 1);
+        m_changedSurfaces.resize(surfaceIndex + 1);
+    }
+    
+    // Acquire the new buffers first, so those shared with the old surface stay alive
+    vector<Drawable> drawables;
+    size_t acquired = m_acquiredBytes;
+    CreateDrawables(surface, drawables);
+    m_surfaceBytes[surfaceIndex] = m_acquiredBytes - acquired;
+    m_drawables[surfaceIndex].swap(drawables);
+    m_changedSurfaces[surfaceIndex] = true;
+    ReleaseDrawables(drawables);
+}
+
+void RenderingEngine::ReleaseSurface(int surfaceIndex) {
+    ReleaseDrawables(m_drawables[surfaceIndex]);
+    vector<Drawable>().swap(m_drawables[surfaceIndex]);
+    m_surfaceBytes[surfaceIndex] = 0;
+    m_changedSurfaces[surfaceIndex] = true;
+}
+
+size_t RenderingEngine::GetSurfaceBytes(int surfaceIndex) const {
+    return surfaceIndex < (int) m_surfaceBytes.size() ? m_surfaceBytes[surfaceIndex] : 0;
+}
+
+void RenderingEngine::ReleaseDrawables(const vector<Drawable>& drawables) {
+    for (vector<Drawable>::const_iterator drawable = drawables.begin(); drawable != drawables.end(); ++drawable) {
+        if (m_geometry.Release(drawable->Vertices) && m_vertexArena.Free(drawable->Vertices))
+            glDeleteBuffers(1, &drawable->Vertices.Buffer);
+        if (m_geometry.Release(drawable->Indices) && m_indexArena.Free(drawable->Indices))
+            glDeleteBuffers(1, &drawable->Indices.Buffer);
+    }
+}
+
+void RenderingEngine::CreateLargeDrawables(const ISurface& surface, vector<Drawable>& drawables) {
+    vector<float> vertices;
+    const float* vertexData = surface.GetVertexData();
+    if (!vertexData) {
+        surface.GenerateVertices(vertices, VertexFlagsNormal);
+        vertexData = &vertices[0];
+    }
+    vector<GLuint> indices;
+    
+    // Draw with 32-bit indices when the GPU supports them
+    if (m_hasUintIndices) {
+        GenerateLodTriangleIndices(surface, indices);
+        mat4 dequantize;
+        ArenaBlock vertexBlock = AcquireVertices(vertexData, surface.GetVertexCount(), dequantize);
+        ArenaBlock indexBlock = AcquireBlock(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0]);
+        Drawable drawable = { vertexBlock, indexBlock, GL_UNSIGNED_INT };
+        drawable.Dequantize = dequantize;
+        GetLodRanges(surface, drawable.Lods);
+        drawables.push_back(drawable);
+        return;
+    }
+    
+    // Otherwise split it into sub-meshes small enough for 16-bit indices,
+    // drawn at full detail only
+    surface.GenerateTriangleIndices(indices);
+    vector<SubMesh> subMeshes;
+    SplitMesh(indices, surface.GetVertexCount(), subMeshes);
+    for (vector<SubMesh>::const_iterator subMesh = subMeshes.begin(); subMesh != subMeshes.end(); ++subMesh) {
+        vector<float> subMeshVertices;
+        GatherSubMeshVertices(*subMesh, vertexData, 6, subMeshVertices);
+        mat4 dequantize;
+        ArenaBlock vertexBlock = AcquireVertices(&subMeshVertices[0], subMeshVertices.size() / 6, dequantize);
+        const vector<GLushort>& subMeshIndices = subMesh->Indices;
+        ArenaBlock indexBlock = AcquireBlock(GL_ELEMENT_ARRAY_BUFFER, subMeshIndices.size() * sizeof(GLushort), &subMeshIndices[0]);
+        Drawable drawable = { vertexBlock, indexBlock, GL_UNSIGNED_SHORT };
+        drawable.Dequantize = dequantize;
+        LodRange range = { 0, (int) subMeshIndices.size() };
+        drawable.Lods.push_back(range);
+        drawables.push_back(drawable);
+    }
+}
+
+ArenaBlock RenderingEngine::AcquireVertices(const float* vertexData, int vertexCount, mat4& dequantize) {
+    if (m_vertexFormat == VertexFormatFloat) {
+        dequantize = mat4::Identity();
+        return AcquireBlock(GL_ARRAY_BUFFER, vertexCount * sizeof(vec3) * 2, vertexData);
+    }
+    vector<CompactVertex> compactVertices;
+    VertexQuantization quantization;
+    CompressVertices(vertexData, vertexCount, compactVertices, quantization);
+    dequantize = quantization.ToMatrix();
+    return AcquireBlock(GL_ARRAY_BUFFER, vertexCount * sizeof(CompactVertex), &compactVertices[0]);
+}
+
+ArenaBlock RenderingEngine::AcquireBlock(GLenum target, GLsizeiptr size, const GLvoid* data) {
+    m_acquiredBytes += size;
+    GeometryKey key = GeometryRegistry::MakeKey(target, data, size);
+    ArenaBlock block;
+    if (m_geometry.Acquire(key, block))
+        return block;
+    
+    // Copy the data into the arena, adding a buffer to it when none has room
+    BufferArena& arena = GetArena(target);
+    if (!arena.Allocate(size, block)) {
+        GLsizeiptr pageSize = arena.GetNewPageSize(size);
+        arena.AddPage(CreateBuffer(target, pageSize, 0), pageSize);
+        arena.Allocate(size, block);
+    }
+    glBindBuffer(target, block.Buffer);
+    glBufferSubData(target, block.Offset, size, data);
+    m_geometry.Insert(key, block);
+    return block;
+}
+
+BufferArena& RenderingEngine::GetArena(GLenum target) {
+    return target == GL_ARRAY_BUFFER ? m_vertexArena : m_indexArena;
+}
+
+GLuint RenderingEngine::CreateBuffer(GLenum target, GLsizeiptr size, const GLvoid* data) const {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    return buffer;
+}
+
+void RenderingEngine::Render(const VisualList& visuals) const {
+    // Clear and draw only the damaged region, unless that is everything
+    ivec2 lowerLeft, size;
+    FindDamage(visuals, lowerLeft, size);
+    bool isPartial = !(lowerLeft == ivec2(0, 0) && size == m_framebufferSize);
+    if (isPartial) {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(lowerLeft.x, lowerLeft.y, size.x, size.y);
+    }
     glClearColor(0.0f, 0.125f, 0.25f, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    vector<Visual>::const_iterator visual = visuals.begin();
-    for (int visualIndex = 0; visual != visuals.end(); ++visual, ++visualIndex) {
-        
-        // Viewport Transform
-        ivec2 size = visual->ViewportSize;
-        ivec2 lowerLeft = visual->LowerLeft;
-        glViewport(lowerLeft.x, lowerLeft.y, size.x, size.y);
-        
-        // Light Position
-        vec4 lightPosition(0.25, 0.25, 1, 0);
-        glUniform3fv(m_uniforms.LightPosition, 1, lightPosition.Pointer());
+    BuildCommands(visuals);
+    ExecuteCommands();
+    if (isPartial) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+    m_stats.PixelsSaved = m_framebufferSize.x * m_framebufferSize.y - size.x * size.y;
+}
+
+static bool IsSameVisual(const Visual& a, const Visual& b) {
+    return a.Color == b.Color && a.LowerLeft == b.LowerLeft && a.ViewportSize == b.ViewportSize &&
+        a.Orientation == b.Orientation && a.Position == b.Position && a.Surface == b.Surface;
+}
+
+static void ExtendBounds(ivec2& lower, ivec2& upper, ivec2 lowerLeft, ivec2 size) {
+    lower = ivec2(std::min(lower.x, lowerLeft.x), std::min(lower.y, lowerLeft.y));
+    upper = ivec2(std::max(upper.x, lowerLeft.x + size.x), std::max(upper.y, lowerLeft.y + size.y));
+}
+
+// The region to redraw: the whole framebuffer when redrawing fully or when the
+// visuals aren't the ones last drawn, otherwise the rectangle bounding where
+// the changed visuals were and where they are now. Every visual overlapping
+// it is drawn again, the others are left as they are in the framebuffer.
+void RenderingEngine::FindDamage(const VisualList& visuals, ivec2& lowerLeft, ivec2& size) const {
+    ivec2 lower(0, 0);
+    ivec2 upper = m_framebufferSize;
+    if (m_redrawMode == RedrawModePartial && (int) m_previousVisuals.size() == visuals.Count) {
+        lower = m_framebufferSize;
+        upper = ivec2(0, 0);
+        for (int visualIndex = 0; visualIndex < visuals.Count; ++visualIndex) {
+            const Visual& visual = visuals[visualIndex];
+            const Visual& previous = m_previousVisuals[visualIndex];
+            if (m_changedSurfaces[visual.Surface] || !IsSameVisual(visual, previous)) {
+                ExtendBounds(lower, upper, previous.LowerLeft, previous.ViewportSize);
+                ExtendBounds(lower, upper, visual.LowerLeft, visual.ViewportSize);
+            }
+        }
+        lower = ivec2(std::max(lower.x, 0), std::max(lower.y, 0));
+        upper = ivec2(std::min(upper.x, m_framebufferSize.x), std::min(upper.y, m_framebufferSize.y));
+        if (upper.x <= lower.x || upper.y <= lower.y) {
+            lower = upper = ivec2(0, 0);
+        }
+    }
+    lowerLeft = lower;
+    size = upper - lower;
+    
+    m_redrawVisuals.resize(visuals.Count);
+    m_previousVisuals.resize(visuals.Count);
+    for (int visualIndex = 0; visualIndex < visuals.Count; ++visualIndex) {
+        const Visual& visual = visuals[visualIndex];
+        ivec2 visualUpper = visual.LowerLeft + visual.ViewportSize;
+        m_redrawVisuals[visualIndex] = visual.LowerLeft.x < upper.x && lower.x < visualUpper.x &&
+            visual.LowerLeft.y < upper.y && lower.y < visualUpper.y;
+        m_previousVisuals[visualIndex] = visual;
+    }
+    m_changedSurfaces.assign(m_changedSurfaces.size(), false);
+}
+
+void RenderingEngine::BuildCommands(const VisualList& visuals) const {
+    m_visualStates.resize(visuals.Count);
+    m_commands.clear();
+    m_stats.DrawCallsSaved = 0;
+    ivec2 projectionSize(0, 0);
+    mat4 projection;
+    int viewport = -1;
+    for (int visualIndex = 0; visualIndex < visuals.Count; ++visualIndex) {
+        if (!m_redrawVisuals[visualIndex]) {
+            m_stats.DrawCallsSaved += m_drawables[visuals[visualIndex].Surface].size();
+            continue;
+        }
+        const Visual& visual = visuals[visualIndex];
+        VisualState& state = m_visualStates[visualIndex];
         
-        // Model-View Transform
-        mat4 rotation = visual->Orientation.ToMatrix();
-        mat4 modelview = rotation * m_translation;
-        glUniformMatrix4fv(m_uniforms.ModelView, 1, 0, modelview.Pointer());
+        // Viewport and Projection Transform, reused while the size stays the same
+        ivec2 size = visual.ViewportSize;
+        if (!(size == projectionSize)) {
+            float h = 4.0 * size.y / size.x;
+            projection = mat4::Frustum(-2, 2, -h / 2, h / 2, 5, 10);
+            projectionSize = size;
+        }
+        if (viewport == -1 || !(visual.LowerLeft == visuals[visualIndex - 1].LowerLeft &&
+                                size == visuals[visualIndex - 1].ViewportSize)) {
+            ++viewport;
+        }
+        state.LowerLeft = visual.LowerLeft;
+        state.Size = size;
+        state.Projection = projection;
         
-        // Set Normal Matrix
+        // Model-View Transform, and the Normal Matrix
         // (It is orthogonal, so its inverse transpose is itself)
-        mat3 normalMatrix = modelview.ToMat3();
-        glUniformMatrix3fv(m_uniforms.NormalMatrix, 1, 0, normalMatrix.Pointer());
-        
-        // Projection Transform
-        float h = 4.0 * size.y / size.x;
-        mat4 projectionMatrix = mat4::Frustum(-2, 2, -h / 2, h / 2, 5, 10);
-        glUniformMatrix4fv(m_uniforms.Projection, 1, 0, projectionMatrix.Pointer());
+        mat4 rotation = visual.Orientation.ToMatrix();
+        state.ModelView = rotation * mat4::Translate(visual.Position) * m_translation;
+        state.NormalMatrix = state.ModelView.ToMat3();
         
         // Diffuse Color
-        vec3 color = visual->Color * 0.75;
-        glVertexAttrib4f(m_attributes.Diffuse, color.x, color.y, color.z, 1);
+        vec3 color = visual.Color * 0.75;
+        state.Diffuse = vec4(color, 1);
         
-        // Draw the surface
-        int stride = sizeof(vec3) * 2;
-        const GLvoid * offset = (const GLvoid *)sizeof(vec3);
-        GLint position = m_attributes.Position;
-        GLint normal = m_attributes.Normal;
-        const Drawable & drawable = m_drawables[visualIndex];
-        glBindBuffer(GL_ARRAY_BUFFER, drawable.VertexBuffer);
-        glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, stride, 0);
-        glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, stride, offset);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable.IndexBuffer);
-        glDrawElements(GL_TRIANGLES, drawable.IndexCount, GL_UNSIGNED_SHORT, 0);
+        // A draw per drawable of the surface, at the level of detail its viewport calls for
+        const vector<Drawable>& drawables = m_drawables[visual.Surface];
+        for (vector<Drawable>::const_iterator drawable = drawables.begin(); drawable != drawables.end(); ++drawable) {
+            const LodRange& lod = drawable->Lods[ChooseLod(drawable->Lods, size)];
+            size_t indexSize = drawable->IndexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+            DrawCommand command = {
+                m_program, drawable->Vertices.Buffer, drawable->Indices.Buffer, drawable->Vertices.Offset,
+                drawable->Indices.Offset + lod.FirstIndex * indexSize, lod.IndexCount, drawable->IndexType,
+                m_vertexFormat == VertexFormatCompact ? &drawable->Dequantize : 0, viewport, visualIndex
+            };
+            m_commands.push_back(command);
+        }
+    }
+    std::sort(m_commands.begin(), m_commands.end());
+    BuildBatches();
+}
+
+// Splits the sorted commands into runs of instances, and lays out the
+// modelview and color of every batched instance for the batches to upload.
+void RenderingEngine::BuildBatches() const {
+    m_batches.clear();
+    m_instanceModelviews.clear();
+    m_instanceColors.clear();
+    m_stats.InstancesBatched = 0;
+    int commandCount = m_commands.size();
+    for (int first = 0; first < commandCount; ) {
+        int last = first + 1;
+        while (last < commandCount && m_commands[last].IsInstanceOf(m_commands[first]))
+            ++last;
+        DrawBatch batch = { first, last - first, -1 };
+        if (batch.CommandCount > 1 && m_instancing != InstancingNone) {
+            batch.FirstInstance = m_instanceModelviews.size();
+            for (int command = first; command < last; ++command) {
+                const VisualState& visual = m_visualStates[m_commands[command].Visual];
+                m_instanceModelviews.push_back(visual.ModelView);
+                m_instanceColors.push_back(visual.Diffuse);
+            }
+            m_stats.InstancesBatched += batch.CommandCount;
+        }
+        m_batches.push_back(batch);
+        first = last;
+    }
+}
+
+void RenderingEngine::ExecuteCommands() const {
+    m_state.Reset();
+    
+    // Upload the instance streams for the whole frame at once: modelviews,
+    // then colors
+    if (m_instancing == InstancingArrays && !m_instanceModelviews.empty()) {
+        size_t modelviewSize = m_instanceModelviews.size() * sizeof(mat4);
+        size_t colorSize = m_instanceColors.size() * sizeof(vec4);
+        m_state.BindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, modelviewSize + colorSize, 0, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, modelviewSize, &m_instanceModelviews[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, modelviewSize, colorSize, &m_instanceColors[0]);
+    }
+    
+    // Counted here rather than traced, so builds without MODELVIEWER_TRACE_GL
+    // report them too
+    int drawCalls = 0;
+    bool instanceArraysEnabled = false;
+    for (vector<DrawBatch>::const_iterator batch = m_batches.begin(); batch != m_batches.end(); ++batch) {
+        bool isInstanced = batch->FirstInstance != -1 && m_instancing == InstancingArrays;
+        if (isInstanced != instanceArraysEnabled) {
+            EnableInstanceArrays(isInstanced);
+            instanceArraysEnabled = isInstanced;
+        }
+        if (isInstanced) {
+            DrawInstanced(*batch);
+            ++drawCalls;
+        } else if (batch->FirstInstance != -1) {
+            DrawBatched(*batch); // A draw per instance, the uniform arrays picking its transform
+            drawCalls += batch->CommandCount;
+        } else {
+            drawCalls += batch->CommandCount;
+            for (int command = 0; command < batch->CommandCount; ++command)
+                Draw(m_commands[batch->FirstCommand + command]);
+        }
+    }
+    if (instanceArraysEnabled)
+        EnableInstanceArrays(false);
+    
+    m_stats.DrawCalls = drawCalls;
+    m_stats.StateCallsIssued = m_state.GetIssuedCount();
+    m_stats.StateCallsElided = m_state.GetElidedCount();
+    m_stats.Calls = GLTrace::TakeCounts();
+}
+
+void RenderingEngine::Draw(const DrawCommand& command) const {
+    const VisualState& visual = m_visualStates[command.Visual];
+    m_state.UseProgram(command.Program);
+    m_state.Viewport(visual.LowerLeft, visual.Size);
+    m_state.Uniform(m_uniforms.LightPosition, vec3(0.25, 0.25, 1));
+    m_state.Uniform(m_uniforms.Projection, visual.Projection);
+    if (command.Dequantize)
+        m_state.Uniform(m_uniforms.ModelView, *command.Dequantize * visual.ModelView);
+    else
+        m_state.Uniform(m_uniforms.ModelView, visual.ModelView);
+    m_state.Uniform(m_uniforms.NormalMatrix, visual.NormalMatrix);
+    m_state.VertexAttrib(m_attributes.Diffuse, visual.Diffuse);
+    BindGeometry(command);
+    glDrawElements(GL_TRIANGLES, command.IndexCount, command.IndexType, (const GLvoid *) command.FirstIndex);
+}
+
+void RenderingEngine::DrawInstanced(const DrawBatch& batch) const {
+    const DrawCommand& command = m_commands[batch.FirstCommand];
+    const VisualState& visual = m_visualStates[command.Visual];
+    m_state.UseProgram(m_batchProgram);
+    m_state.Viewport(visual.LowerLeft, visual.Size);
+    m_state.Uniform(m_batchUniforms.LightPosition, vec3(0.25, 0.25, 1));
+    m_state.Uniform(m_batchUniforms.Projection, visual.Projection);
+    BindGeometry(command);
+    
+    // Each instance's modelview and color, from the streams uploaded for the frame
+    size_t colorOffset = m_instanceModelviews.size() * sizeof(mat4);
+    m_state.BindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    for (int column = 0; column < 4; ++column) {
+        m_state.VertexAttribPointer(InstanceModelviewAttribute + column, 4, GL_FLOAT, sizeof(mat4),
+                                    batch.FirstInstance * sizeof(mat4) + column * sizeof(vec4));
+    }
+    m_state.VertexAttribPointer(InstanceDiffuseAttribute, 4, GL_FLOAT, sizeof(vec4),
+                                colorOffset + batch.FirstInstance * sizeof(vec4));
+    glDrawElementsInstancedEXT(GL_TRIANGLES, command.IndexCount, command.IndexType, (const GLvoid *) command.FirstIndex,
+                               batch.CommandCount);
+}
+
+void RenderingEngine::DrawBatched(const DrawBatch& batch) const {
+    const DrawCommand& command = m_commands[batch.FirstCommand];
+    const VisualState& visual = m_visualStates[command.Visual];
+    m_state.UseProgram(m_batchProgram);
+    m_state.Viewport(visual.LowerLeft, visual.Size);
+    m_state.Uniform(m_batchUniforms.LightPosition, vec3(0.25, 0.25, 1));
+    m_state.Uniform(m_batchUniforms.Projection, visual.Projection);
+    BindGeometry(command);
+    
+    // The arrays are too big for the state cache, and always change
+    for (int first = 0; first < batch.CommandCount; first += UniformBatchSize) {
+        int count = std::min(UniformBatchSize, batch.CommandCount - first);
+        int instance = batch.FirstInstance + first;
+        glUniformMatrix4fv(m_batchUniforms.InstanceModelview, count, 0, m_instanceModelviews[instance].Pointer());
+        glUniform4fv(m_batchUniforms.InstanceDiffuse, count, m_instanceColors[instance].Pointer());
+        for (int index = 0; index < count; ++index) {
+            glUniform1f(m_batchUniforms.InstanceIndex, index);
+            glDrawElements(GL_TRIANGLES, command.IndexCount, command.IndexType, (const GLvoid *) command.FirstIndex);
+        }
+    }
+}
+
+// ES 2.0 has no base vertex, so the attributes point at the draw's vertices
+void RenderingEngine::BindGeometry(const DrawCommand& command) const {
+    bool isCompact = m_vertexFormat == VertexFormatCompact;
+    GLsizei stride = isCompact ? sizeof(CompactVertex) : sizeof(vec3) * 2;
+    GLenum type = isCompact ? GL_SHORT : GL_FLOAT;
+    size_t normalOffset = isCompact ? offsetof(CompactVertex, Normal) : sizeof(vec3);
+    m_state.BindBuffer(GL_ARRAY_BUFFER, command.VertexBuffer);
+    m_state.VertexAttribPointer(m_attributes.Position, isCompact ? 4 : 3, type, stride, command.VertexOffset);
+    m_state.VertexAttribPointer(m_attributes.Normal, isCompact ? 2 : 3, type, stride, command.VertexOffset + normalOffset);
+    m_state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, command.IndexBuffer);
+}
+
+void RenderingEngine::EnableInstanceArrays(bool enabled) const {
+    for (GLuint attribute = InstanceModelviewAttribute; attribute <= InstanceDiffuseAttribute; ++attribute) {
+        if (enabled)
+            glEnableVertexAttribArray(attribute);
+        else
+            glDisableVertexAttribArray(attribute);
     }
 }
     
@@ -192,6 +765,11 @@ GLuint RenderingEngine::BuildProgram(const char* vertexShaderSource, const char*
     GLuint programHandle = glCreateProgram();
     glAttachShader(programHandle, vertexShader);
     glAttachShader(programHandle, fragmentShader);
+    glBindAttribLocation(programHandle, PositionAttribute, "Position");
+    glBindAttribLocation(programHandle, NormalAttribute, "Normal");
+    glBindAttribLocation(programHandle, DiffuseAttribute, "DiffuseMaterial");
+    glBindAttribLocation(programHandle, InstanceModelviewAttribute, "InstanceModelview");
+    glBindAttribLocation(programHandle, InstanceDiffuseAttribute, "InstanceDiffuse");
     glLinkProgram(programHandle);
     GLint linkSuccess;
     glGetProgramiv(programHandle, GL_LINK_STATUS, &linkSuccess);
@@ -217,4 +795,140 @@ GLuint RenderingEngine::BuildShader(const char* source, GLenum shaderType) const
     return shaderHandle;
 }
     
+bool DrawCommand::operator<(const DrawCommand& command) const {
+    if (Program != command.Program)
+        return Program < command.Program;
+    if (VertexBuffer != command.VertexBuffer)
+        return VertexBuffer < command.VertexBuffer;
+    if (IndexBuffer != command.IndexBuffer)
+        return IndexBuffer < command.IndexBuffer;
+    if (VertexOffset != command.VertexOffset)
+        return VertexOffset < command.VertexOffset;
+    if (FirstIndex != command.FirstIndex)
+        return FirstIndex < command.FirstIndex;
+    if (Viewport != command.Viewport)
+        return Viewport < command.Viewport;
+    return Visual < command.Visual;
+}
+
+bool DrawCommand::IsInstanceOf(const DrawCommand& command) const {
+    return Program == command.Program && VertexBuffer == command.VertexBuffer && IndexBuffer == command.IndexBuffer &&
+        VertexOffset == command.VertexOffset && FirstIndex == command.FirstIndex && IndexCount == command.IndexCount &&
+        IndexType == command.IndexType && Dequantize == command.Dequantize && Viewport == command.Viewport;
+}
+
+StateCache::StateCache() {
+    Reset();
+}
+
+void StateCache::Reset() {
+    m_program = 0;
+    m_viewportLowerLeft = ivec2(0, 0);
+    m_viewportSize = ivec2(-1, -1);
+    m_arrayBuffer = 0;
+    m_elementArrayBuffer = 0;
+    for (int i = 0; i < MaxAttributes; ++i) {
+        AttributePointer none = { 0, 0, 0, 0, 0 };
+        m_pointers[i] = none;
+        m_hasAttribute[i] = false;
+    }
+    m_uniformCount = 0;
+    m_issued = 0;
+    m_elided = 0;
+}
+
+bool StateCache::IsSet(bool same) {
+    if (same)
+        ++m_elided;
+    else
+        ++m_issued;
+    return same;
+}
+
+void StateCache::UseProgram(GLuint program) {
+    if (IsSet(program == m_program))
+        return;
+    glUseProgram(program);
+    m_program = program;
+    
+    // Uniform values belong to the program
+    m_uniformCount = 0;
+}
+
+void StateCache::Viewport(ivec2 lowerLeft, ivec2 size) {
+    if (IsSet(lowerLeft == m_viewportLowerLeft && size == m_viewportSize))
+        return;
+    glViewport(lowerLeft.x, lowerLeft.y, size.x, size.y);
+    m_viewportLowerLeft = lowerLeft;
+    m_viewportSize = size;
+}
+
+void StateCache::BindBuffer(GLenum target, GLuint buffer) {
+    GLuint& bound = target == GL_ARRAY_BUFFER ? m_arrayBuffer : m_elementArrayBuffer;
+    if (IsSet(buffer == bound))
+        return;
+    glBindBuffer(target, buffer);
+    bound = buffer;
+}
+
+void StateCache::VertexAttribPointer(GLuint index, GLint size, GLenum type, GLsizei stride, size_t offset) {
+    AttributePointer pointer = { m_arrayBuffer, size, type, stride, offset };
+    if (index < MaxAttributes) {
+        AttributePointer& cached = m_pointers[index];
+        if (IsSet(cached.Buffer == pointer.Buffer && pointer.Buffer != 0 && cached.Size == size &&
+                  cached.Type == type && cached.Stride == stride && cached.Offset == offset))
+            return;
+        cached = pointer;
+    } else {
+        ++m_issued;
+    }
+    glVertexAttribPointer(index, size, type, GL_FALSE, stride, (const GLubyte *) 0 + offset);
+}
+
+void StateCache::VertexAttrib(GLuint index, const vec4& value) {
+    if (index < MaxAttributes) {
+        if (IsSet(m_hasAttribute[index] && memcmp(&m_attributes[index], &value, sizeof(vec4)) == 0))
+            return;
+        m_attributes[index] = value;
+        m_hasAttribute[index] = true;
+    } else {
+        ++m_issued;
+    }
+    glVertexAttrib4fv(index, value.Pointer());
+}
+
+void StateCache::Uniform(GLint location, const vec3& value) {
+    if (!IsUniformSet(location, value.Pointer(), 3))
+        glUniform3fv(location, 1, value.Pointer());
+}
+
+void StateCache::Uniform(GLint location, const mat3& value) {
+    if (!IsUniformSet(location, value.Pointer(), 9))
+        glUniformMatrix3fv(location, 1, 0, value.Pointer());
+}
+
+void StateCache::Uniform(GLint location, const mat4& value) {
+    if (!IsUniformSet(location, value.Pointer(), 16))
+        glUniformMatrix4fv(location, 1, 0, value.Pointer());
+}
+
+bool StateCache::IsUniformSet(GLint location, const float* values, int count) {
+    // Few enough uniforms to look them up in turn
+    int i = 0;
+    while (i < m_uniformCount && m_uniforms[i].Location != location)
+        ++i;
+    if (i == MaxUniforms)
+        return IsSet(false);
+    UniformValue& uniform = m_uniforms[i];
+    size_t size = count * sizeof(float);
+    if (IsSet(i < m_uniformCount && uniform.Count == count && memcmp(uniform.Values, values, size) == 0))
+        return true;
+    if (i == m_uniformCount)
+        ++m_uniformCount;
+    uniform.Location = location;
+    uniform.Count = count;
+    memcpy(uniform.Values, values, size);
+    return false;
+}
+    
 }
\ No newline at end of file
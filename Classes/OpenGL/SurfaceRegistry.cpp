@@ -0,0 +1,212 @@
+//
+//  SurfaceRegistry.cpp
+//  ModelViewer
+//
+
+#include "SurfaceRegistry.hpp"
+#include <assert.h>
+
+// Hands a surface to the loader without giving it up: the loader deletes
+// what it is given once loaded, and the registry tessellates the same
+// surface again after every eviction.
+class SharedSurface : public ISurface {
+public:
+    SharedSurface(const ISurface& surface) : m_surface(surface) {}
+    int GetVertexCount() const { return m_surface.GetVertexCount(); }
+    int GetLineIndexCount() const { return m_surface.GetLineIndexCount(); }
+    int GetTriangleIndexCount() const { return m_surface.GetTriangleIndexCount(); }
+    void GenerateVertices(vector<float>& vertices, unsigned char flags) const { m_surface.GenerateVertices(vertices, flags); }
+    void GenerateLineIndices(vector<unsigned short>& indices) const { m_surface.GenerateLineIndices(indices); }
+    void GenerateTriangleIndices(vector<unsigned short>& indices) const { m_surface.GenerateTriangleIndices(indices); }
+    void GenerateTriangleIndices(vector<unsigned int>& indices) const { m_surface.GenerateTriangleIndices(indices); }
+    int GetLodCount() const { return m_surface.GetLodCount(); }
+    int GetLodTriangleIndexCount(int lod) const { return m_surface.GetLodTriangleIndexCount(lod); }
+    void GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const
+    {
+        m_surface.GenerateLodTriangleIndices(lod, indices);
+    }
+    const float* GetVertexData() const { return m_surface.GetVertexData(); }
+    const unsigned short* GetTriangleIndexData() const { return m_surface.GetTriangleIndexData(); }
+private:
+    const ISurface& m_surface;
+};
+
+SurfaceRegistry::SurfaceRegistry(IRenderingEngine * engine, const string& cacheDirectory, size_t budgetBytes) :
+m_engine(engine),
+m_cacheDirectory(cacheDirectory),
+m_frame(0),
+m_budgetBytes(budgetBytes),
+m_residentBytes(0),
+m_residentCount(0),
+m_hits(0),
+m_misses(0),
+m_evictions(0),
+m_loads(0)
+{
+    Entry placeholder = { "", 0, SurfaceUnloaded, 0, 0 };
+    m_entries.push_back(placeholder);
+}
+
+SurfaceRegistry::~SurfaceRegistry()
+{
+    for (size_t i = 0; i < m_batches.size(); ++i)
+        delete m_batches[i].Loader;
+    for (size_t i = 0; i < m_entries.size(); ++i)
+        delete m_entries[i].Surface;
+}
+
+void SurfaceRegistry::Initialize(const ISurface& placeholder)
+{
+    vector<ISurface*> surfaces(1, const_cast<ISurface*>(&placeholder));
+    m_engine->Initialize(surfaces);
+    Entry& entry = m_entries[Placeholder];
+    entry.State = SurfaceResident;
+    entry.Bytes = m_engine->GetSurfaceBytes(Placeholder);
+    m_residentBytes += entry.Bytes;
+    ++m_residentCount;
+}
+
+int SurfaceRegistry::AddObjFile(const string& path)
+{
+    Entry entry = { path, 0, SurfaceUnloaded, 0, 0 };
+    m_entries.push_back(entry);
+    return m_entries.size() - 1;
+}
+
+int SurfaceRegistry::AddSurface(ISurface * surface)
+{
+    Entry entry = { "", surface, SurfaceUnloaded, 0, 0 };
+    m_entries.push_back(entry);
+    return m_entries.size() - 1;
+}
+
+bool SurfaceRegistry::Request(int handle)
+{
+    Entry& entry = m_entries[handle];
+    entry.LastRequested = m_frame;
+    if (entry.State == SurfaceResident) {
+        ++m_hits;
+        return true;
+    }
+    // Surfaces already on their way count once, when queued
+    if (entry.State == SurfaceUnloaded) {
+        entry.State = SurfaceLoading;
+        m_queued.push_back(handle);
+        ++m_misses;
+    }
+    return false;
+}
+
+bool SurfaceRegistry::Update()
+{
+    CancelLoads();
+    if (!m_queued.empty())
+        StartLoads();
+    
+    // Cancelled loads and empty surfaces don't take up the frame's upload
+    bool uploaded = false;
+    for (size_t i = 0; i < m_batches.size() && !uploaded; ++i) {
+        LoadBatch& batch = m_batches[i];
+        ISurface * surface;
+        int surfaceIndex;
+        while (!uploaded && (surfaceIndex = batch.Loader->TakeFinished(&surface)) != -1) {
+            int handle = batch.Handles[surfaceIndex];
+            if (handle != -1)
+                uploaded = Upload(handle, *surface);
+            delete surface;
+        }
+    }
+    for (size_t i = 0; i < m_batches.size();) {
+        if (m_batches[i].Loader->IsDone()) {
+            delete m_batches[i].Loader;
+            m_batches.erase(m_batches.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+    Evict();
+    ++m_frame;
+    return uploaded;
+}
+
+void SurfaceRegistry::StartLoads()
+{
+    // Everything queued since the last batch goes through a new loader, in
+    // parallel, rather than waiting for the loads under way to finish
+    LoadBatch batch = { new SurfaceLoader(m_cacheDirectory) };
+    for (size_t i = 0; i < m_queued.size(); ++i) {
+        const Entry& entry = m_entries[m_queued[i]];
+        if (entry.Surface)
+            batch.Loader->AddSurface(new SharedSurface(*entry.Surface));
+        else
+            batch.Loader->AddObjFile(entry.ObjPath);
+    }
+    batch.Handles.swap(m_queued);
+    batch.Loader->Start();
+    m_batches.push_back(batch);
+}
+
+void SurfaceRegistry::CancelLoads()
+{
+    // Surfaces the frame no longer draws are loaded again if requested again
+    for (size_t i = 0; i < m_batches.size(); ++i) {
+        LoadBatch& batch = m_batches[i];
+        for (size_t surfaceIndex = 0; surfaceIndex < batch.Handles.size(); ++surfaceIndex) {
+            int handle = batch.Handles[surfaceIndex];
+            if (handle == -1 || m_entries[handle].LastRequested == m_frame)
+                continue;
+            batch.Loader->Cancel(surfaceIndex);
+            batch.Handles[surfaceIndex] = -1;
+            m_entries[handle].State = SurfaceUnloaded;
+        }
+    }
+}
+
+bool SurfaceRegistry::Upload(int handle, const ISurface& surface)
+{
+    Entry& entry = m_entries[handle];
+    assert(entry.State == SurfaceLoading && "Only surfaces being loaded are uploaded.");
+    if (surface.GetVertexCount() == 0 || surface.GetTriangleIndexCount() == 0) {
+        entry.State = SurfaceEmpty;
+        return false;
+    }
+    m_engine->SetSurface(handle, surface);
+    entry.State = SurfaceResident;
+    entry.Bytes = m_engine->GetSurfaceBytes(handle);
+    m_residentBytes += entry.Bytes;
+    ++m_residentCount;
+    ++m_loads;
+    return true;
+}
+
+void SurfaceRegistry::Evict()
+{
+    while (m_residentBytes > m_budgetBytes) {
+        // The least recently requested, leaving those of this frame alone
+        int victim = -1;
+        for (size_t handle = Placeholder + 1; handle < m_entries.size(); ++handle) {
+            const Entry& entry = m_entries[handle];
+            if (entry.State != SurfaceResident || entry.LastRequested == m_frame)
+                continue;
+            if (victim == -1 || entry.LastRequested < m_entries[victim].LastRequested)
+                victim = handle;
+        }
+        if (victim == -1)
+            return;
+    
+        Entry& entry = m_entries[victim];
+        m_engine->ReleaseSurface(victim);
+        entry.State = SurfaceUnloaded;
+        m_residentBytes -= entry.Bytes;
+        entry.Bytes = 0;
+        --m_residentCount;
+        ++m_evictions;
+    }
+}
+
+SurfaceStats SurfaceRegistry::GetStats() const
+{
+    SurfaceStats stats = { (int) m_entries.size(), m_residentCount, m_residentBytes, m_budgetBytes, m_hits, m_misses,
+                           m_evictions, m_loads };
+    return stats;
+}
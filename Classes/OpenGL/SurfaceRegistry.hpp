@@ -0,0 +1,94 @@
+//
+//  SurfaceRegistry.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_SurfaceRegistry_h
+#define ModelViewer_SurfaceRegistry_h
+
+#include "Interfaces.hpp"
+#include "SurfaceLoader.hpp"
+
+// Keeps any number of surfaces for a rendering engine, loading each only
+// once it is wanted and keeping what the loaded ones take up of the engine's
+// memory within a budget. Adding a surface loads nothing; every frame,
+// Request marks the surfaces the frame draws, queueing loads for those not
+// resident, and Update starts the queued loads alongside those under way,
+// drops the loads of surfaces the frame no longer draws, uploads a finished
+// load, then releases the surfaces least recently requested until the rest
+// fit the budget. Surfaces released
+// are loaded again, on background threads, when next requested: OBJ files
+// through the mesh cache, parametric surfaces tessellated again.
+// Surfaces requested by the current frame are never released, so a budget
+// too small for one frame is exceeded rather than thrashed.
+// Surfaces that load with nothing to draw, e.g. from an empty or unreadable
+// OBJ file, are never uploaded and the placeholder stands in for them.
+// Handles are the engine's surface indices; handle Placeholder is the
+// surface drawn in place of those not resident, and is always resident.
+class SurfaceRegistry {
+public:
+    static const int Placeholder = 0;
+    // OBJ files are loaded through the mesh cache in cacheDirectory.
+    SurfaceRegistry(IRenderingEngine * engine, const string& cacheDirectory, size_t budgetBytes);
+    // Waits for the loads under way, and deletes the surfaces added.
+    ~SurfaceRegistry();
+    // Initializes the rendering engine with the placeholder as its only surface.
+    void Initialize(const ISurface& placeholder);
+    // Each returns the surface's handle.
+    int AddObjFile(const string& path);
+    int AddSurface(ISurface * surface); // Takes ownership
+    int GetSurfaceCount() const { return m_entries.size(); }
+    void SetBudget(size_t bytes) { m_budgetBytes = bytes; }
+    // Marks the surface as drawn by this frame, queueing its load if it is
+    // neither resident nor loading. Returns whether it is resident.
+    bool Request(int handle);
+    bool IsResident(int handle) const { return m_entries[handle].State == SurfaceResident; }
+    // Ends the frame: starts loading the surfaces queued, cancels the loads
+    // of those this frame didn't request, uploads at most one finished load,
+    // to keep frame times even, and releases surfaces to fit the budget.
+    // Returns whether a surface became resident.
+    bool Update();
+    // Whether any surface is queued or loading.
+    bool IsLoading() const { return !m_batches.empty() || !m_queued.empty(); }
+    SurfaceStats GetStats() const;
+private:
+    enum SurfaceState {
+        SurfaceUnloaded,
+        SurfaceLoading, // Queued, or on the loader
+        SurfaceResident,
+        SurfaceEmpty // Loaded with nothing to draw, so never loaded again
+    };
+    struct Entry {
+        string ObjPath; // Empty for surfaces given ready to tessellate
+        ISurface * Surface; // What is tessellated on every load, owned
+        SurfaceState State;
+        size_t Bytes; // What the rendering engine says it takes up, while resident
+        unsigned int LastRequested; // Frame number
+    };
+    // The surfaces queued by one frame, loading on a loader of their own.
+    struct LoadBatch {
+        SurfaceLoader * Loader;
+        vector<int> Handles; // By the loader's surface index, -1 once cancelled
+    };
+    SurfaceRegistry(const SurfaceRegistry&);
+    SurfaceRegistry& operator=(const SurfaceRegistry&);
+    void StartLoads();
+    void CancelLoads();
+    bool Upload(int handle, const ISurface& surface);
+    void Evict();
+    IRenderingEngine * m_engine;
+    string m_cacheDirectory;
+    vector<Entry> m_entries; // By handle
+    vector<int> m_queued; // Handles waiting for a loader
+    vector<LoadBatch> m_batches; // Under way, oldest first
+    unsigned int m_frame;
+    size_t m_budgetBytes;
+    size_t m_residentBytes;
+    int m_residentCount;
+    int m_hits;
+    int m_misses;
+    int m_evictions;
+    int m_loads;
+};
+
+#endif
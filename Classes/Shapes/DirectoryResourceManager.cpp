@@ -0,0 +1,25 @@
+//
+//  DirectoryResourceManager.cpp
+//  ModelViewer
+//
+
+#include "Interfaces.hpp"
+
+// Resources and caches in plain directories, for builds without an app bundle.
+class DirectoryResourceManager : public IResourceManager {
+public:
+    DirectoryResourceManager(const string& resourcePath, const string& cachePath) :
+    m_resourcePath(resourcePath),
+    m_cachePath(cachePath)
+    {
+    }
+    string GetResourcepath() const { return m_resourcePath; }
+    string GetCachePath() const { return m_cachePath; }
+private:
+    string m_resourcePath;
+    string m_cachePath;
+};
+
+IResourceManager * CreateDirectoryResourceManager(const string& resourcePath, const string& cachePath) {
+    return new DirectoryResourceManager(resourcePath, cachePath);
+}
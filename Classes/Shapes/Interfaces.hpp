@@ -23,11 +23,66 @@ enum VertexFlags {
     VertexFlagsTexCoords = 1 << 1,
 };
 
+// How the OpenGL ES 2.0 backend stores vertices: six floats, 24 bytes, or
+// 12 bytes of quantized position and octahedral normal (VertexCompression.hpp).
+enum VertexFormat {
+    VertexFormatFloat,
+    VertexFormatCompact,
+};
+
+// Whether the OpenGL ES 2.0 backend redraws the whole framebuffer each frame,
+// or only the region of the visuals that changed since the last one. Partial
+// redraw needs the framebuffer to keep its contents between frames.
+enum RedrawMode {
+    RedrawModeFull,
+    RedrawModePartial,
+};
+
 struct IResourceManager {
     virtual string GetResourcepath() const =0;
+    virtual string GetCachePath() const =0;
     virtual ~IResourceManager() {}
 };
 
+// GL calls made, counted at the entry points by GLTrace.hpp.
+struct GLCallCounts {
+    int DrawCalls;
+    int Triangles;
+    int BufferBinds;
+    int UniformUploads; // With ES1, matrices, lights and materials
+    int StateChanges; // Anything else set: viewport, program, pointers...
+    size_t BytesUploaded; // Into buffers
+};
+
+// What the last frame submitted, for profiling.
+struct RenderStats {
+    int DrawCalls; // Issued, an instanced draw counting once
+    int StateCallsIssued; // State changes made
+    int StateCallsElided; // State changes skipped, the state being set already
+    int InstancesBatched; // Drawn along with others of the same drawable
+    // With partial redraw, what redrawing only the changed region saved
+    // over redrawing the whole framebuffer.
+    int DrawCallsSaved;
+    int PixelsSaved;
+    // Since the previous frame, so uploads between frames count. Only
+    // counted when built with MODELVIEWER_TRACE_GL, zero otherwise.
+    GLCallCounts Calls;
+};
+
+// How the surfaces held for the rendering engine fit its memory budget.
+struct SurfaceStats {
+    int SurfaceCount; // Known, resident or not
+    int ResidentCount; // Uploaded to the rendering engine
+    size_t ResidentBytes;
+    size_t BudgetBytes;
+    int Hits; // Requests for surfaces that were resident
+    int Misses; // Requests that had to queue a load, once per load
+    int Evictions; // Released to stay within the budget
+    int Loads; // Uploads, counting those of surfaces evicted earlier
+};
+
+class FrameProfiler;
+
 struct IApplicationEngine {
     virtual void Initialize(int width, int height) = 0;
     virtual void Render() const = 0;
@@ -35,6 +90,20 @@ struct IApplicationEngine {
     virtual void OnFingerUp(ivec2 location) = 0;
     virtual void OnFingerDown(ivec2 location) = 0;
     virtual void OnFingerMove(ivec2 oldLocation, ivec2 newLocation) = 0;
+    // Whether some surfaces are still loading, and drawn as placeholders.
+    virtual bool IsLoading() const = 0;
+    // Whether anything drawn changed since the last Render, after
+    // UpdateAnimation; if not, the frame can be skipped.
+    virtual bool NeedsRedraw() const = 0;
+    virtual RenderStats GetRenderStats() const = 0;
+    virtual SurfaceStats GetSurfaceStats() const = 0;
+    // Caps the rendering engine memory the surfaces take up; the least
+    // recently drawn surfaces are released past it, and loaded again when
+    // they are next drawn.
+    virtual void SetSurfaceBudget(size_t bytes) = 0;
+    // How long the phases of each frame take; the host times the whole frame
+    // and presenting it, the engine the rest.
+    virtual FrameProfiler& GetFrameProfiler() = 0;
     virtual ~IApplicationEngine() {}
 };
 
@@ -45,29 +114,69 @@ struct ISurface {
     virtual void GenerateVertices(vector<float>& vertices, unsigned char flags = 0) const = 0;
     virtual void GenerateLineIndices(vector<unsigned short>& indices) const = 0;
     virtual void GenerateTriangleIndices(vector<unsigned short>& indices) const = 0;
+    virtual void GenerateTriangleIndices(vector<unsigned int>& indices) const = 0;
+    // Coarser triangle lists over the same vertices, for drawing at small sizes.
+    // Level 0 is the full list that GenerateTriangleIndices produces.
+    virtual int GetLodCount() const { return 1; }
+    virtual int GetLodTriangleIndexCount(int lod) const { return GetTriangleIndexCount(); }
+    virtual void GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const { GenerateTriangleIndices(indices); }
+    // Ready-made buffers in the layout GenerateVertices(VertexFlagsNormal) and
+    // GenerateTriangleIndices produce, for surfaces that already hold them.
+    // The index data holds every level of detail, back to back.
+    virtual const float* GetVertexData() const { return 0; }
+    virtual const unsigned short* GetTriangleIndexData() const { return 0; }
     virtual ~ISurface() {}
 };
 
+// One instance of a surface: visuals may share a surface, and a viewport.
 struct Visual {
+    Visual() : Position(0, 0, 0), Surface(0) {}
     vec3 Color;
     ivec2 LowerLeft;
     ivec2 ViewportSize;
     Quaternion Orientation;
+    vec3 Position; // Where the surface sits, after it is rotated
+    int Surface; // Which of the surfaces the rendering engine was given
+};
+
+// The visuals of one frame, in memory the caller owns; only valid during the
+// Render call it is passed to.
+struct VisualList {
+    VisualList(const Visual* visuals, int count) : Visuals(visuals), Count(count) {}
+    const Visual& operator[](int index) const { return Visuals[index]; }
+    const Visual* Visuals;
+    int Count;
 };
 
 struct IRenderingEngine {
     virtual void Initialize(const vector<ISurface*>& surfaces) = 0;
-    virtual void Render(const vector<Visual>& visuals) const = 0;
+    virtual void Render(const VisualList& visuals) const = 0;
+    // Swaps the surface visuals with Surface == surfaceIndex draw, e.g. a
+    // placeholder for the real surface once it has loaded. Indices past the
+    // surfaces given so far add surfaces.
+    virtual void SetSurface(int surfaceIndex, const ISurface& surface) = 0;
+    // Frees what the surface takes up; visuals must not draw it until it is
+    // set again.
+    virtual void ReleaseSurface(int surfaceIndex) = 0;
+    // The buffer memory the surface takes up, counting blocks it shares with
+    // other surfaces in full.
+    virtual size_t GetSurfaceBytes(int surfaceIndex) const = 0;
+    virtual RenderStats GetRenderStats() const { RenderStats none = {}; return none; }
     virtual ~IRenderingEngine() {}
 };
 
 IResourceManager * CreateResourceManager();
+IResourceManager * CreateDirectoryResourceManager(const string& resourcePath, const string& cachePath);
 IApplicationEngine * CreateApplicationEngine(IRenderingEngine * renderingEngine, IResourceManager * resourceManager);
 namespace ES1 {
     IRenderingEngine * CreateRenderingEngine();
 }
 namespace ES2 {
-    IRenderingEngine * CreateRenderingEngine();
+    IRenderingEngine * CreateRenderingEngine(VertexFormat vertexFormat = VertexFormatFloat,
+                                             RedrawMode redrawMode = RedrawModeFull);
+}
+namespace Software {
+    IRenderingEngine * CreateRenderingEngine(int width, int height);
 }
 
 #endif /* defined(__WireframeSkeleton__Interfaces__) */
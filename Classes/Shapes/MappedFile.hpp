@@ -0,0 +1,29 @@
+//
+//  MappedFile.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_MappedFile_h
+#define ModelViewer_MappedFile_h
+
+#include <string>
+
+using std::string;
+
+// Read-only view of a whole file, mapped into memory for the lifetime of the object.
+class MappedFile {
+public:
+    MappedFile(const string& path);
+    ~MappedFile();
+    bool IsValid() const { return m_data != 0; }
+    const char* Begin() const { return m_data; }
+    const char* End() const { return m_data + m_size; }
+    size_t Size() const { return m_size; }
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+    const char* m_data;
+    size_t m_size;
+};
+
+#endif
@@ -0,0 +1,230 @@
+//
+//  MeshCache.cpp
+//  ModelViewer
+//
+
+#include "MeshCache.hpp"
+#include "ObjSurface.hpp"
+#include "MeshSplit.hpp"
+#include "MeshOptimizer.hpp"
+#include <cstdio>
+#include <cstring>
+#include <assert.h>
+
+using namespace std;
+
+static const char MeshCacheMagic[4] = { 'M', 'E', 'S', 'H' };
+static const unsigned int MeshCacheVersion = 3;
+static const unsigned int MeshCacheFloatsPerVertex = 6;
+
+static volatile int s_temporaryFileCount = 0;
+
+MeshCacheSurface::MeshCacheSurface(const string& path, unsigned long long sourceHash) :
+m_file(path),
+m_header(0),
+m_vertices(0),
+m_indices(0)
+{
+    if (m_file.Size() < sizeof(MeshCacheHeader))
+        return;
+    
+    const MeshCacheHeader* header = (const MeshCacheHeader*) m_file.Begin();
+    if (memcmp(header->Magic, MeshCacheMagic, sizeof(MeshCacheMagic)) != 0 ||
+        header->Version != MeshCacheVersion ||
+        header->FloatsPerVertex != MeshCacheFloatsPerVertex ||
+        (header->IndexSize != sizeof(unsigned short) && header->IndexSize != sizeof(unsigned int)) ||
+        header->SourceHash != sourceHash ||
+        header->LodCount < 1 || header->LodCount > (unsigned int) MaxMeshCacheLods ||
+        header->LodIndexCounts[0] != header->IndexCount)
+        return;
+    
+    size_t vertexBytes = header->VertexCount * header->FloatsPerVertex * sizeof(float);
+    size_t indexBytes = 0;
+    for (unsigned int lod = 0; lod < header->LodCount; ++lod) {
+        m_lodOffsets[lod] = indexBytes;
+        indexBytes += header->LodIndexCounts[lod] * header->IndexSize;
+    }
+    if (m_file.Size() != sizeof(MeshCacheHeader) + vertexBytes + indexBytes)
+        return;
+    
+    m_header = header;
+    m_vertices = (const float*) (m_file.Begin() + sizeof(MeshCacheHeader));
+    m_indices = m_file.Begin() + sizeof(MeshCacheHeader) + vertexBytes;
+}
+
+void MeshCacheSurface::GenerateVertices(vector<float>& vertices, unsigned char flags) const
+{
+    assert(flags == VertexFlagsNormal && "Unsupported flags.");
+    vertices.assign(m_vertices, m_vertices + GetVertexCount() * MeshCacheFloatsPerVertex);
+}
+
+void MeshCacheSurface::GenerateTriangleIndices(vector<unsigned short>& indices) const
+{
+    if (m_header->IndexSize == sizeof(unsigned short)) {
+        const unsigned short* data = (const unsigned short*) m_indices;
+        indices.assign(data, data + GetTriangleIndexCount());
+    } else {
+        assert(GetVertexCount() <= MaxShortIndexVertices && "Too many vertices for 16-bit indices.");
+        const unsigned int* data = (const unsigned int*) m_indices;
+        indices.assign(data, data + GetTriangleIndexCount());
+    }
+}
+
+void MeshCacheSurface::GenerateTriangleIndices(vector<unsigned int>& indices) const
+{
+    if (m_header->IndexSize == sizeof(unsigned int)) {
+        const unsigned int* data = (const unsigned int*) m_indices;
+        indices.assign(data, data + GetTriangleIndexCount());
+    } else {
+        const unsigned short* data = (const unsigned short*) m_indices;
+        indices.assign(data, data + GetTriangleIndexCount());
+    }
+}
+
+void MeshCacheSurface::GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const
+{
+    const char* level = m_indices + m_lodOffsets[lod];
+    if (m_header->IndexSize == sizeof(unsigned int)) {
+        const unsigned int* data = (const unsigned int*) level;
+        indices.assign(data, data + GetLodTriangleIndexCount(lod));
+    } else {
+        const unsigned short* data = (const unsigned short*) level;
+        indices.assign(data, data + GetLodTriangleIndexCount(lod));
+    }
+}
+
+const unsigned short* MeshCacheSurface::GetTriangleIndexData() const
+{
+    if (m_header->IndexSize != sizeof(unsigned short))
+        return 0;
+    return (const unsigned short*) m_indices;
+}
+
+unsigned long long HashBytes(const char* begin, const char* end)
+{
+    // FNV-1a over 8-byte words, with an extra shift to spread the high bits down.
+    const unsigned long long prime = 1099511628211ULL;
+    unsigned long long hash = 14695981039346656037ULL ^ (unsigned long long) (end - begin);
+    const char* p = begin;
+    for (; end - p >= 8; p += 8) {
+        unsigned long long word;
+        memcpy(&word, p, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; p != end; ++p)
+        hash = (hash ^ (unsigned char) *p) * prime;
+    return hash;
+}
+
+bool WriteMeshCache(const ISurface& surface, const string& path, unsigned long long sourceHash)
+{
+    vector<float> vertices;
+    surface.GenerateVertices(vertices, VertexFlagsNormal);
+    vector<unsigned short> shortIndices;
+    vector<unsigned int> indices;
+    bool wideIndices = surface.GetVertexCount() > MaxShortIndexVertices;
+    int lodCount = min(surface.GetLodCount(), MaxMeshCacheLods);
+    vector<unsigned int> level;
+    for (int lod = 0; lod < lodCount; ++lod) {
+        surface.GenerateLodTriangleIndices(lod, level);
+        if (wideIndices)
+            indices.insert(indices.end(), level.begin(), level.end());
+        else
+            shortIndices.insert(shortIndices.end(), level.begin(), level.end());
+    }
+    
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, MeshCacheMagic, sizeof(MeshCacheMagic));
+    header.Version = MeshCacheVersion;
+    header.VertexCount = surface.GetVertexCount();
+    header.IndexCount = surface.GetTriangleIndexCount();
+    header.FloatsPerVertex = MeshCacheFloatsPerVertex;
+    header.IndexSize = wideIndices ? sizeof(unsigned int) : sizeof(unsigned short);
+    header.SourceHash = sourceHash;
+    header.LodCount = lodCount;
+    for (int lod = 0; lod < MaxMeshCacheLods; ++lod)
+        header.LodIndexCounts[lod] = lod < lodCount ? surface.GetLodTriangleIndexCount(lod) : 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.BoundsMin[axis] = vertices.empty() ? 0 : vertices[axis];
+        header.BoundsMax[axis] = header.BoundsMin[axis];
+    }
+    for (size_t v = 0; v < vertices.size(); v += MeshCacheFloatsPerVertex) {
+        for (int axis = 0; axis < 3; ++axis) {
+            header.BoundsMin[axis] = min(header.BoundsMin[axis], vertices[v + axis]);
+            header.BoundsMax[axis] = max(header.BoundsMax[axis], vertices[v + axis]);
+        }
+    }
+    
+    // Write to a temporary file first so a reader never maps a partial cache,
+    // one of its own so two loads of the same surface don't write into each other.
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", __sync_fetch_and_add(&s_temporaryFileCount, 1));
+    string temporaryPath = path + suffix;
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!vertices.empty())
+        written = written && fwrite(&vertices[0], sizeof(vertices[0]), vertices.size(), file) == vertices.size();
+    if (!indices.empty())
+        written = written && fwrite(&indices[0], sizeof(indices[0]), indices.size(), file) == indices.size();
+    if (!shortIndices.empty())
+        written = written && fwrite(&shortIndices[0], sizeof(shortIndices[0]), shortIndices.size(), file) == shortIndices.size();
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+unsigned long long HashFile(const string& path)
+{
+    MappedFile file(path);
+    return HashBytes(file.Begin(), file.End());
+}
+
+unsigned long long HashSurface(const ISurface& surface)
+{
+    vector<float> positions;
+    surface.GenerateVertices(positions, 0);
+    vector<unsigned int> indices;
+    surface.GenerateTriangleIndices(indices);
+    const char* positionBytes = positions.empty() ? 0 : (const char*) &positions[0];
+    const char* indexBytes = indices.empty() ? 0 : (const char*) &indices[0];
+    unsigned long long positionHash = HashBytes(positionBytes, positionBytes + positions.size() * sizeof(float));
+    unsigned long long indexHash = HashBytes(indexBytes, indexBytes + indices.size() * sizeof(unsigned int));
+    return positionHash ^ (indexHash * 1099511628211ULL);
+}
+
+string GetMeshCachePath(const string& objPath, const string& cacheDirectory)
+{
+    size_t slash = objPath.find_last_of('/');
+    string name = objPath.substr(slash == string::npos ? 0 : slash + 1);
+    return cacheDirectory + "/" + name + ".mesh";
+}
+
+string GetSurfaceCachePath(unsigned long long sourceHash, const string& cacheDirectory)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "Surface-%016llx.mesh", sourceHash);
+    return cacheDirectory + "/" + name;
+}
+
+ISurface * CreateCachedObjSurface(const string& objPath, const string& cacheDirectory)
+{
+    unsigned long long sourceHash = HashFile(objPath);
+    string cachePath = GetMeshCachePath(objPath, cacheDirectory);
+    
+    MeshCacheSurface * cached = new MeshCacheSurface(cachePath, sourceHash);
+    if (cached->IsValid())
+        return cached;
+    delete cached;
+    
+    // Stale or missing: parse and optimize the OBJ file and leave a fresh cache for next time.
+    ISurface * surface = new OptimizedSurface(new ObjSurface(objPath));
+    WriteMeshCache(*surface, cachePath, sourceHash);
+    return surface;
+}
@@ -0,0 +1,78 @@
+//
+//  MeshCache.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_MeshCache_h
+#define ModelViewer_MeshCache_h
+
+#include "Interfaces.hpp"
+#include "MappedFile.hpp"
+
+// On-disk layout: the header, then VertexCount * FloatsPerVertex floats
+// (position and normal, as GenerateVertices(VertexFlagsNormal) produces them),
+// then the indices of each level of detail back to back, LodIndexCounts[lod]
+// indices of IndexSize bytes each. Level 0 is what GenerateTriangleIndices
+// produces. Indices are 16-bit unless the mesh has too many vertices for them.
+static const int MaxMeshCacheLods = 8;
+
+struct MeshCacheHeader {
+    char Magic[4];
+    unsigned int Version;
+    unsigned int VertexCount;
+    unsigned int IndexCount;
+    unsigned int FloatsPerVertex;
+    unsigned int IndexSize;
+    float BoundsMin[3];
+    float BoundsMax[3];
+    unsigned long long SourceHash;
+    unsigned int LodCount;
+    unsigned int LodIndexCounts[MaxMeshCacheLods];
+};
+
+// A surface served straight out of a mapped mesh cache file.
+class MeshCacheSurface : public ISurface {
+public:
+    MeshCacheSurface(const string& path, unsigned long long sourceHash);
+    bool IsValid() const { return m_header != 0; }
+    int GetVertexCount() const { return m_header->VertexCount; }
+    int GetLineIndexCount() const { return 0; }
+    int GetTriangleIndexCount() const { return m_header->IndexCount; }
+    void GenerateVertices(vector<float>& vertices, unsigned char flags) const;
+    void GenerateLineIndices(vector<unsigned short>& indices) const {}
+    void GenerateTriangleIndices(vector<unsigned short>& indices) const;
+    void GenerateTriangleIndices(vector<unsigned int>& indices) const;
+    int GetLodCount() const { return m_header->LodCount; }
+    int GetLodTriangleIndexCount(int lod) const { return m_header->LodIndexCounts[lod]; }
+    void GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const;
+    const float* GetVertexData() const { return m_vertices; }
+    const unsigned short* GetTriangleIndexData() const;
+private:
+    MappedFile m_file;
+    const MeshCacheHeader* m_header;
+    const float* m_vertices;
+    const char* m_indices;
+    size_t m_lodOffsets[MaxMeshCacheLods];
+};
+
+// 64-bit hash of a block of memory, used to tell whether a cache is stale.
+unsigned long long HashBytes(const char* begin, const char* end);
+unsigned long long HashFile(const string& path);
+// Hash of what a surface tessellates to, standing in for the source file of
+// surfaces made in code: it changes with their type, parameters and divisions.
+unsigned long long HashSurface(const ISurface& surface);
+
+// Where the cache for an OBJ file goes in cacheDirectory.
+string GetMeshCachePath(const string& objPath, const string& cacheDirectory);
+// Where the cache for a surface with HashSurface sourceHash goes.
+string GetSurfaceCachePath(unsigned long long sourceHash, const string& cacheDirectory);
+
+// Writes surface to path in the mesh cache format, tagged with sourceHash.
+bool WriteMeshCache(const ISurface& surface, const string& path, unsigned long long sourceHash);
+
+// Loads an OBJ file through its mesh cache in cacheDirectory. The cache is
+// rebuilt from the OBJ file when it is missing or the source has changed, and
+// holds the mesh already reordered and simplified by OptimizedSurface.
+ISurface * CreateCachedObjSurface(const string& objPath, const string& cacheDirectory);
+
+#endif
@@ -0,0 +1,264 @@
+//
+//  MeshOptimizer.cpp
+//  ModelViewer
+//
+
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshSplit.hpp"
+#include <cmath>
+#include <assert.h>
+
+using namespace std;
+
+// Scoring constants from Forsyth's paper.
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+static const int MaxScoredValence = 64;
+
+struct VertexScoreTable {
+    VertexScoreTable()
+    {
+        for (int position = 0; position < VertexCacheSize; ++position) {
+            if (position < 3) {
+                Cache[position] = LastTriangleScore;
+            } else {
+                const float scaler = 1.0f / (VertexCacheSize - 3);
+                Cache[position] = powf(1.0f - (position - 3) * scaler, CacheDecayPower);
+            }
+        }
+        Valence[0] = 0;
+        for (int valence = 1; valence < MaxScoredValence; ++valence)
+            Valence[valence] = ValenceBoostScale * powf((float) valence, -ValenceBoostPower);
+    }
+    float Score(int cachePosition, int remainingValence) const
+    {
+        if (remainingValence == 0)
+            return -1;
+        float score = cachePosition >= 0 ? Cache[cachePosition] : 0;
+        return score + Valence[min(remainingValence, MaxScoredValence - 1)];
+    }
+    float Cache[VertexCacheSize];
+    float Valence[MaxScoredValence];
+};
+
+void OptimizeVertexCache(vector<unsigned int>& indices, int vertexCount)
+{
+    int triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+    const VertexScoreTable scores;
+    
+    // Triangles adjacent to each vertex; the first Valence entries are the ones not yet emitted.
+    vector<int> valence(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); ++i)
+        ++valence[indices[i]];
+    vector<int> firstTriangle(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; ++v)
+        firstTriangle[v + 1] = firstTriangle[v] + valence[v];
+    vector<int> adjacency(indices.size());
+    vector<int> filled(vertexCount, 0);
+    for (int t = 0; t < triangleCount; ++t) {
+        for (int corner = 0; corner < 3; ++corner) {
+            int v = indices[t * 3 + corner];
+            adjacency[firstTriangle[v] + filled[v]++] = t;
+        }
+    }
+    
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScore(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        vertexScore[v] = scores.Score(-1, valence[v]);
+    vector<float> triangleScore(triangleCount);
+    for (int t = 0; t < triangleCount; ++t) {
+        triangleScore[t] = vertexScore[indices[t * 3]] +
+                           vertexScore[indices[t * 3 + 1]] +
+                           vertexScore[indices[t * 3 + 2]];
+    }
+    
+    vector<bool> emitted(triangleCount, false);
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    int cache[VertexCacheSize + 3];
+    int cacheCount = 0;
+    int bestTriangle = 0;
+    int scanCursor = 0;
+    
+    for (int emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        // When nothing in the cache has triangles left, take the next unused triangle.
+        if (bestTriangle < 0) {
+            while (emitted[scanCursor])
+                ++scanCursor;
+            bestTriangle = scanCursor;
+        }
+        
+        const unsigned int* triangle = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+        
+        // Retire the triangle from its vertices' adjacency lists.
+        for (int corner = 0; corner < 3; ++corner) {
+            int v = triangle[corner];
+            int* list = &adjacency[firstTriangle[v]];
+            int last = --valence[v];
+            for (int i = 0; i <= last; ++i) {
+                if (list[i] == bestTriangle) {
+                    swap(list[i], list[last]);
+                    break;
+                }
+            }
+        }
+        
+        // Move the triangle's vertices to the front of the cache.
+        int newCache[VertexCacheSize + 3];
+        int newCount = 0;
+        for (int corner = 0; corner < 3; ++corner) {
+            if (corner == 0 || triangle[corner] != triangle[0]) {
+                if (corner < 2 || triangle[2] != triangle[1])
+                    newCache[newCount++] = triangle[corner];
+            }
+        }
+        for (int i = 0; i < cacheCount; ++i) {
+            int v = cache[i];
+            if (v != (int) triangle[0] && v != (int) triangle[1] && v != (int) triangle[2])
+                newCache[newCount++] = v;
+        }
+        
+        // Rescore every vertex that moved, including the ones pushed out, and pick
+        // the best of the triangles they touch.
+        bestTriangle = -1;
+        float bestScore = -1;
+        for (int i = 0; i < newCount; ++i) {
+            int v = newCache[i];
+            cachePosition[v] = i < VertexCacheSize ? i : -1;
+            float score = scores.Score(cachePosition[v], valence[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            const int* list = &adjacency[firstTriangle[v]];
+            for (int j = 0; j < valence[v]; ++j) {
+                int t = list[j];
+                triangleScore[t] += delta;
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+        cacheCount = min(newCount, (int) VertexCacheSize);
+        for (int i = 0; i < cacheCount; ++i)
+            cache[i] = newCache[i];
+    }
+    indices.swap(result);
+}
+
+void OptimizeVertexFetch(vector<unsigned int>& indices, int vertexCount, vector<unsigned int>& remap)
+{
+    const unsigned int unassigned = ~0u;
+    remap.assign(vertexCount, unassigned);
+    unsigned int next = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        unsigned int& vertex = remap[indices[i]];
+        if (vertex == unassigned)
+            vertex = next++;
+        indices[i] = vertex;
+    }
+    for (int v = 0; v < vertexCount; ++v) {
+        if (remap[v] == unassigned)
+            remap[v] = next++;
+    }
+}
+
+// Number of vertices a FIFO post-transform cache has to transform for the list.
+static int CountTransformedVertices(const vector<unsigned int>& indices, int vertexCount, int cacheSize)
+{
+    // A vertex is in the cache if it was transformed less than cacheSize misses ago.
+    vector<int> transformedAt(vertexCount, -cacheSize - 1);
+    int misses = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        unsigned int v = indices[i];
+        if (misses - transformedAt[v] > cacheSize) {
+            transformedAt[v] = misses;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+float ComputeACMR(const vector<unsigned int>& indices, int vertexCount, int cacheSize)
+{
+    if (indices.empty())
+        return 0;
+    return CountTransformedVertices(indices, vertexCount, cacheSize) / (indices.size() / 3.0f);
+}
+
+float ComputeATVR(const vector<unsigned int>& indices, int vertexCount, int cacheSize)
+{
+    if (vertexCount == 0)
+        return 0;
+    return CountTransformedVertices(indices, vertexCount, cacheSize) / (float) vertexCount;
+}
+
+OptimizedSurface::OptimizedSurface(ISurface * surface) :
+m_surface(surface)
+{
+    m_surface->GenerateTriangleIndices(m_indices);
+    OptimizeVertexCache(m_indices, GetVertexCount());
+    OptimizeVertexFetch(m_indices, GetVertexCount(), m_remap);
+    
+    // The levels of detail share the reordered vertices; each gets its own triangle order.
+    vector<float> vertices;
+    GenerateVertices(vertices, 0);
+    BuildLodChain(vertices, 3, m_indices, m_lods);
+    for (size_t lod = 0; lod < m_lods.size(); ++lod)
+        OptimizeVertexCache(m_lods[lod], GetVertexCount());
+}
+
+OptimizedSurface::~OptimizedSurface()
+{
+    delete m_surface;
+}
+
+void OptimizedSurface::GenerateVertices(vector<float>& vertices, unsigned char flags) const
+{
+    vector<float> original;
+    m_surface->GenerateVertices(original, flags);
+    vertices.resize(original.size());
+    if (original.empty())
+        return;
+    
+    int floatsPerVertex = original.size() / GetVertexCount();
+    for (int v = 0; v < GetVertexCount(); ++v) {
+        const float* source = &original[v * floatsPerVertex];
+        copy(source, source + floatsPerVertex, &vertices[m_remap[v] * floatsPerVertex]);
+    }
+}
+
+void OptimizedSurface::GenerateLineIndices(vector<unsigned short>& indices) const
+{
+    m_surface->GenerateLineIndices(indices);
+    for (size_t i = 0; i < indices.size(); ++i)
+        indices[i] = m_remap[indices[i]];
+}
+
+void OptimizedSurface::GenerateTriangleIndices(vector<unsigned short>& indices) const
+{
+    assert(GetVertexCount() <= MaxShortIndexVertices && "Too many vertices for 16-bit indices.");
+    indices.assign(m_indices.begin(), m_indices.end());
+}
+
+void OptimizedSurface::GenerateTriangleIndices(vector<unsigned int>& indices) const
+{
+    indices = m_indices;
+}
+
+int OptimizedSurface::GetLodTriangleIndexCount(int lod) const
+{
+    return lod == 0 ? m_indices.size() : m_lods[lod - 1].size();
+}
+
+void OptimizedSurface::GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const
+{
+    indices = lod == 0 ? m_indices : m_lods[lod - 1];
+}
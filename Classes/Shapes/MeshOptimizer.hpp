@@ -0,0 +1,54 @@
+//
+//  MeshOptimizer.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_MeshOptimizer_h
+#define ModelViewer_MeshOptimizer_h
+
+#include "Interfaces.hpp"
+
+// Size of the simulated post-transform cache used for ordering and statistics.
+static const int VertexCacheSize = 32;
+
+// Reorders the triangles of an indexed triangle list for the post-transform
+// vertex cache, following Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+void OptimizeVertexCache(vector<unsigned int>& indices, int vertexCount);
+
+// Renumbers the vertices in the order the triangles first use them, so vertex
+// fetches walk memory forwards. remap receives the new index of every old vertex;
+// unused vertices go last, in their original order.
+void OptimizeVertexFetch(vector<unsigned int>& indices, int vertexCount, vector<unsigned int>& remap);
+
+// Average number of vertices transformed per triangle (ACMR) and per vertex (ATVR)
+// with a FIFO cache of cacheSize entries. Lower is better; 0.5 and 1.0 are the ideals.
+float ComputeACMR(const vector<unsigned int>& indices, int vertexCount, int cacheSize = VertexCacheSize);
+float ComputeATVR(const vector<unsigned int>& indices, int vertexCount, int cacheSize = VertexCacheSize);
+
+// Wraps a surface, serving its triangles in cache-optimized order and its
+// vertices in fetch-optimized order, along with a chain of simplified levels
+// of detail. Takes ownership of the wrapped surface.
+class OptimizedSurface : public ISurface {
+public:
+    OptimizedSurface(ISurface * surface);
+    ~OptimizedSurface();
+    int GetVertexCount() const { return m_surface->GetVertexCount(); }
+    int GetLineIndexCount() const { return m_surface->GetLineIndexCount(); }
+    int GetTriangleIndexCount() const { return m_indices.size(); }
+    void GenerateVertices(vector<float>& vertices, unsigned char flags) const;
+    void GenerateLineIndices(vector<unsigned short>& indices) const;
+    void GenerateTriangleIndices(vector<unsigned short>& indices) const;
+    void GenerateTriangleIndices(vector<unsigned int>& indices) const;
+    int GetLodCount() const { return m_lods.size() + 1; }
+    int GetLodTriangleIndexCount(int lod) const;
+    void GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const;
+private:
+    OptimizedSurface(const OptimizedSurface&);
+    OptimizedSurface& operator=(const OptimizedSurface&);
+    ISurface * m_surface;
+    vector<unsigned int> m_indices;
+    vector<unsigned int> m_remap;
+    vector< vector<unsigned int> > m_lods;
+};
+
+#endif
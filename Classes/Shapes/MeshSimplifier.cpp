@@ -0,0 +1,285 @@
+//
+//  MeshSimplifier.cpp
+//  ModelViewer
+//
+
+#include "MeshSimplifier.hpp"
+#include <queue>
+#include <algorithm>
+
+using namespace std;
+
+// Symmetric 4x4 matrix summing the squared distances to a set of planes.
+struct Quadric {
+    Quadric()
+    {
+        fill(m, m + 10, 0.0);
+    }
+    Quadric(double a, double b, double c, double d, double weight)
+    {
+        m[0] = a * a; m[1] = a * b; m[2] = a * c; m[3] = a * d;
+        m[4] = b * b; m[5] = b * c; m[6] = b * d;
+        m[7] = c * c; m[8] = c * d;
+        m[9] = d * d;
+        for (int i = 0; i < 10; ++i)
+            m[i] *= weight;
+    }
+    void operator+=(const Quadric& q)
+    {
+        for (int i = 0; i < 10; ++i)
+            m[i] += q.m[i];
+    }
+    double Error(const vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+               m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+               m[7] * z * z + 2 * m[8] * z +
+               m[9];
+    }
+    double m[10];
+};
+
+// Collapsing From onto To, as seen when both vertices had the given versions.
+struct Collapse {
+    double Cost;
+    int From;
+    int To;
+    int FromVersion;
+    int ToVersion;
+    bool operator<(const Collapse& c) const
+    {
+        return Cost > c.Cost;
+    }
+};
+
+class Simplifier {
+public:
+    Simplifier(const vector<float>& vertices, int floatsPerVertex, const vector<unsigned int>& indices);
+    void Run(vector< vector<unsigned int> >& lods);
+private:
+    vec3 Normal(int triangle) const;
+    bool IsDegenerate(int triangle) const;
+    void PushCollapses(int vertex);
+    bool CanCollapse(int from, int to) const;
+    void DoCollapse(int from, int to);
+    void Snapshot(vector<unsigned int>& lod) const;
+    vector<vec3> m_positions;
+    vector<unsigned int> m_indices;
+    vector<bool> m_removed;
+    vector< vector<int> > m_vertexTriangles;
+    vector<Quadric> m_quadrics;
+    vector<int> m_version;
+    vector<bool> m_locked;
+    vector<bool> m_collapsed;
+    priority_queue<Collapse> m_queue;
+    int m_liveTriangles;
+};
+
+Simplifier::Simplifier(const vector<float>& vertices, int floatsPerVertex, const vector<unsigned int>& indices) :
+m_indices(indices),
+m_removed(indices.size() / 3, false),
+m_liveTriangles(indices.size() / 3)
+{
+    int vertexCount = vertices.size() / floatsPerVertex;
+    m_positions.resize(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        m_positions[v] = vec3(vertices[v * floatsPerVertex], vertices[v * floatsPerVertex + 1], vertices[v * floatsPerVertex + 2]);
+    m_vertexTriangles.resize(vertexCount);
+    m_quadrics.resize(vertexCount);
+    m_version.resize(vertexCount, 0);
+    m_locked.resize(vertexCount, false);
+    m_collapsed.resize(vertexCount, false);
+    
+    // Each vertex starts with the area-weighted planes of the triangles around it.
+    for (int t = 0; t < m_liveTriangles; ++t) {
+        vec3 a = m_positions[m_indices[t * 3]];
+        vec3 n = (m_positions[m_indices[t * 3 + 1]] - a).Cross(m_positions[m_indices[t * 3 + 2]] - a);
+        float area = n.Length();
+        Quadric plane;
+        if (area > 0) {
+            n /= area;
+            plane = Quadric(n.x, n.y, n.z, -n.Dot(a), area);
+        }
+        for (int corner = 0; corner < 3; ++corner) {
+            int v = m_indices[t * 3 + corner];
+            m_quadrics[v] += plane;
+            m_vertexTriangles[v].push_back(t);
+        }
+    }
+    
+    // An edge used by a single triangle is a boundary or an attribute seam; its vertices stay put.
+    vector< pair<unsigned int, unsigned int> > edges;
+    edges.reserve(m_indices.size());
+    for (size_t t = 0; t < m_indices.size(); t += 3) {
+        for (int corner = 0; corner < 3; ++corner) {
+            unsigned int a = m_indices[t + corner];
+            unsigned int b = m_indices[t + (corner + 1) % 3];
+            edges.push_back(make_pair(min(a, b), max(a, b)));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); ) {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j] == edges[i])
+            ++j;
+        if (j - i == 1) {
+            m_locked[edges[i].first] = true;
+            m_locked[edges[i].second] = true;
+        }
+        i = j;
+    }
+    
+    for (int v = 0; v < vertexCount; ++v)
+        PushCollapses(v);
+}
+
+vec3 Simplifier::Normal(int triangle) const
+{
+    vec3 a = m_positions[m_indices[triangle * 3]];
+    vec3 b = m_positions[m_indices[triangle * 3 + 1]];
+    vec3 c = m_positions[m_indices[triangle * 3 + 2]];
+    return (b - a).Cross(c - a);
+}
+
+bool Simplifier::IsDegenerate(int triangle) const
+{
+    const unsigned int* t = &m_indices[triangle * 3];
+    return t[0] == t[1] || t[1] == t[2] || t[0] == t[2];
+}
+
+void Simplifier::PushCollapses(int vertex)
+{
+    // Queue a collapse of the vertex onto each neighbour and of each neighbour onto it.
+    const vector<int>& triangles = m_vertexTriangles[vertex];
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        if (m_removed[triangles[i]])
+            continue;
+        for (int corner = 0; corner < 3; ++corner) {
+            int other = m_indices[triangles[i] * 3 + corner];
+            if (other == vertex)
+                continue;
+            Quadric q = m_quadrics[vertex];
+            q += m_quadrics[other];
+            if (!m_locked[vertex]) {
+                Collapse c = { q.Error(m_positions[other]), vertex, other, m_version[vertex], m_version[other] };
+                m_queue.push(c);
+            }
+            if (!m_locked[other]) {
+                Collapse c = { q.Error(m_positions[vertex]), other, vertex, m_version[other], m_version[vertex] };
+                m_queue.push(c);
+            }
+        }
+    }
+}
+
+bool Simplifier::CanCollapse(int from, int to) const
+{
+    // Reject the collapse if it would flip any surviving triangle around from.
+    const vector<int>& triangles = m_vertexTriangles[from];
+    bool adjacent = false;
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        int t = triangles[i];
+        if (m_removed[t])
+            continue;
+        const unsigned int* corners = &m_indices[t * 3];
+        if (corners[0] == (unsigned int) to || corners[1] == (unsigned int) to || corners[2] == (unsigned int) to) {
+            adjacent = true;
+            continue;
+        }
+        vec3 p[3];
+        for (int corner = 0; corner < 3; ++corner)
+            p[corner] = m_positions[corners[corner] == (unsigned int) from ? to : corners[corner]];
+        vec3 before = Normal(t);
+        vec3 after = (p[1] - p[0]).Cross(p[2] - p[0]);
+        if (before.Dot(after) <= 0)
+            return false;
+    }
+    return adjacent;
+}
+
+void Simplifier::DoCollapse(int from, int to)
+{
+    vector<int>& triangles = m_vertexTriangles[from];
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        int t = triangles[i];
+        if (m_removed[t])
+            continue;
+        for (int corner = 0; corner < 3; ++corner) {
+            if (m_indices[t * 3 + corner] == (unsigned int) from)
+                m_indices[t * 3 + corner] = to;
+        }
+        if (IsDegenerate(t)) {
+            m_removed[t] = true;
+            --m_liveTriangles;
+        } else {
+            m_vertexTriangles[to].push_back(t);
+        }
+    }
+    triangles.clear();
+    m_collapsed[from] = true;
+    m_quadrics[to] += m_quadrics[from];
+    ++m_version[from];
+    ++m_version[to];
+    PushCollapses(to);
+}
+
+void Simplifier::Snapshot(vector<unsigned int>& lod) const
+{
+    lod.clear();
+    lod.reserve(m_liveTriangles * 3);
+    for (size_t t = 0; t < m_removed.size(); ++t) {
+        if (!m_removed[t])
+            lod.insert(lod.end(), &m_indices[t * 3], &m_indices[t * 3] + 3);
+    }
+}
+
+void Simplifier::Run(vector< vector<unsigned int> >& lods)
+{
+    int previous = m_liveTriangles;
+    int target = (int) (previous * LodReduction);
+    while (target >= MinLodTriangles && !m_queue.empty()) {
+        Collapse c = m_queue.top();
+        m_queue.pop();
+        if (m_collapsed[c.From] || m_collapsed[c.To] ||
+            c.FromVersion != m_version[c.From] || c.ToVersion != m_version[c.To] ||
+            !CanCollapse(c.From, c.To))
+            continue;
+        DoCollapse(c.From, c.To);
+        
+        if (m_liveTriangles <= target) {
+            lods.push_back(vector<unsigned int>());
+            Snapshot(lods.back());
+            previous = m_liveTriangles;
+            target = (int) (previous * LodReduction);
+        }
+    }
+}
+
+void BuildLodChain(const vector<float>& vertices, int floatsPerVertex, const vector<unsigned int>& indices,
+                   vector< vector<unsigned int> >& lods)
+{
+    lods.clear();
+    Simplifier simplifier(vertices, floatsPerVertex, indices);
+    simplifier.Run(lods);
+}
+
+int ChooseLod(const vector<LodRange>& lods, ivec2 viewportSize)
+{
+    int wanted = viewportSize.x * viewportSize.y / PixelsPerLodTriangle;
+    int lod = 0;
+    while (lod + 1 < (int) lods.size() && lods[lod + 1].IndexCount / 3 >= wanted)
+        ++lod;
+    return lod;
+}
+
+void GetLodRanges(const ISurface& surface, vector<LodRange>& lods)
+{
+    lods.clear();
+    int firstIndex = 0;
+    for (int lod = 0; lod < surface.GetLodCount(); ++lod) {
+        LodRange range = { firstIndex, surface.GetLodTriangleIndexCount(lod) };
+        lods.push_back(range);
+        firstIndex += range.IndexCount;
+    }
+}
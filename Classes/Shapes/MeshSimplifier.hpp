@@ -0,0 +1,53 @@
+//
+//  MeshSimplifier.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_MeshSimplifier_h
+#define ModelViewer_MeshSimplifier_h
+
+#include "Interfaces.hpp"
+
+// Each level of detail has about this fraction of the triangles of the previous one.
+static const float LodReduction = 0.25f;
+
+// No level of detail is built with fewer triangles than this.
+static const int MinLodTriangles = 128;
+
+// Roughly how many pixels of viewport a triangle should cover before a coarser level is used.
+static const int PixelsPerLodTriangle = 16;
+
+// Where one level of detail sits when all levels are stored back to back.
+struct LodRange {
+    int FirstIndex;
+    int IndexCount;
+};
+
+// Builds coarser versions of a triangle list by quadric error metric edge
+// collapses (Garland & Heckbert), collapsing each edge onto one of its existing
+// endpoints so that every level indexes the original vertices. Boundary
+// vertices, which include seams where attributes split a position, are kept.
+// lods receives the levels coarser than indices, finest first.
+void BuildLodChain(const vector<float>& vertices, int floatsPerVertex, const vector<unsigned int>& indices,
+                   vector< vector<unsigned int> >& lods);
+
+// Picks the coarsest level that still has a triangle for every PixelsPerLodTriangle
+// pixels of the viewport. lods lists the levels finest first.
+int ChooseLod(const vector<LodRange>& lods, ivec2 viewportSize);
+
+// The range of each of the surface's levels of detail when stored back to back.
+void GetLodRanges(const ISurface& surface, vector<LodRange>& lods);
+
+// Generates all of the surface's levels of detail back to back.
+template <typename Index>
+void GenerateLodTriangleIndices(const ISurface& surface, vector<Index>& indices)
+{
+    vector<unsigned int> level;
+    indices.clear();
+    for (int lod = 0; lod < surface.GetLodCount(); ++lod) {
+        surface.GenerateLodTriangleIndices(lod, level);
+        indices.insert(indices.end(), level.begin(), level.end());
+    }
+}
+
+#endif
@@ -0,0 +1,54 @@
+//
+//  MeshSplit.cpp
+//  ModelViewer
+//
+
+#include "MeshSplit.hpp"
+#include <cstring>
+#include <assert.h>
+
+void SplitMesh(const vector<unsigned int>& indices, int vertexCount, vector<SubMesh>& subMeshes, int maxVertices)
+{
+    assert(maxVertices >= 3 && maxVertices <= MaxShortIndexVertices);
+    subMeshes.clear();
+    
+    // Local index of each vertex in the current sub-mesh, valid while its stamp matches.
+    vector<unsigned short> local(vertexCount);
+    vector<int> stamp(vertexCount, -1);
+    
+    for (size_t triangle = 0; triangle + 2 < indices.size(); triangle += 3) {
+        int current = (int) subMeshes.size() - 1;
+        int added = 0;
+        if (current >= 0) {
+            for (int corner = 0; corner < 3; ++corner) {
+                unsigned int vertex = indices[triangle + corner];
+                if (stamp[vertex] != current)
+                    ++added;
+            }
+        }
+        if (current < 0 || (int) subMeshes[current].Vertices.size() + added > maxVertices) {
+            subMeshes.push_back(SubMesh());
+            ++current;
+        }
+        
+        SubMesh& subMesh = subMeshes[current];
+        for (int corner = 0; corner < 3; ++corner) {
+            unsigned int vertex = indices[triangle + corner];
+            if (stamp[vertex] != current) {
+                stamp[vertex] = current;
+                local[vertex] = (unsigned short) subMesh.Vertices.size();
+                subMesh.Vertices.push_back(vertex);
+            }
+            subMesh.Indices.push_back(local[vertex]);
+        }
+    }
+}
+
+void GatherSubMeshVertices(const SubMesh& subMesh, const float* vertices, int floatsPerVertex,
+                           vector<float>& subMeshVertices)
+{
+    subMeshVertices.resize(subMesh.Vertices.size() * floatsPerVertex);
+    float* destination = subMeshVertices.empty() ? 0 : &subMeshVertices[0];
+    for (size_t v = 0; v < subMesh.Vertices.size(); ++v, destination += floatsPerVertex)
+        memcpy(destination, vertices + subMesh.Vertices[v] * floatsPerVertex, floatsPerVertex * sizeof(float));
+}
@@ -0,0 +1,31 @@
+//
+//  MeshSplit.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_MeshSplit_h
+#define ModelViewer_MeshSplit_h
+
+#include "Interfaces.hpp"
+
+// Largest vertex count whose indices all fit in an unsigned short.
+static const int MaxShortIndexVertices = 65536;
+
+// A piece of a larger mesh that can be drawn with 16-bit indices.
+struct SubMesh {
+    vector<unsigned int> Vertices; // Index into the full mesh of each local vertex.
+    vector<unsigned short> Indices; // Triangles, in local vertex indices.
+};
+
+// Splits a triangle list over vertexCount vertices into sub-meshes of at most
+// maxVertices vertices each. Triangles are taken in order and a vertex is
+// only repeated in a sub-mesh when one of its triangles lands there, so
+// vertices stay shared except along the seams between sub-meshes.
+void SplitMesh(const vector<unsigned int>& indices, int vertexCount, vector<SubMesh>& subMeshes,
+               int maxVertices = MaxShortIndexVertices);
+
+// Copies the vertices of subMesh out of the full interleaved vertex array.
+void GatherSubMeshVertices(const SubMesh& subMesh, const float* vertices, int floatsPerVertex,
+                           vector<float>& subMeshVertices);
+
+#endif
@@ -0,0 +1,176 @@
+//
+//  NormalGenerator.cpp
+//  ModelViewer
+//
+
+#include "NormalGenerator.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+
+using namespace std;
+
+// Meshes with fewer faces than this get the serial scatter.
+static const int MinParallelFaces = 16384;
+
+// Angle between the edges toward b and c, at a.
+static float CornerAngle(const vec3& a, const vec3& b, const vec3& c)
+{
+    vec3 ab = b - a;
+    vec3 ac = c - a;
+    float lengths = sqrt(ab.Dot(ab) * ac.Dot(ac));
+    if (lengths == 0)
+        return 0;
+    float cosine = ab.Dot(ac) / lengths;
+    return acos(max(-1.0f, min(1.0f, cosine)));
+}
+
+// The face's normal, scaled by its area (twice the area, to be exact).
+static inline vec3 ComputeFacetNormal(const vector<vec3>& positions, const ivec3& face)
+{
+    vec3 a = positions[face.x];
+    return (positions[face.y] - a).Cross(positions[face.z] - a);
+}
+
+// The face's unit normal, with the angle at each corner written to angles.
+static vec3 ComputeFacetNormal(const vector<vec3>& positions, const ivec3& face, float* angles)
+{
+    vec3 a = positions[face.x];
+    vec3 b = positions[face.y];
+    vec3 c = positions[face.z];
+    angles[0] = CornerAngle(a, b, c);
+    angles[1] = CornerAngle(b, c, a);
+    angles[2] = CornerAngle(c, a, b);
+    vec3 facetNormal = (b - a).Cross(c - a);
+    float length = facetNormal.Length();
+    return length > 0 ? facetNormal / length : vec3(0, 0, 0);
+}
+
+// Adds the contributions of faces [firstFace, endFace) to normals, which it
+// doesn't clear or normalize.
+static void ScatterFaces(const vector<vec3>& positions, const vector<ivec3>& faces, int firstFace, int endFace,
+                         NormalWeighting weighting, vec3* normals)
+{
+    for (int faceIndex = firstFace; faceIndex < endFace; ++faceIndex) {
+        const ivec3& face = faces[faceIndex];
+        if (weighting == NormalWeightingArea) {
+            vec3 facetNormal = ComputeFacetNormal(positions, face);
+            normals[face.x] += facetNormal;
+            normals[face.y] += facetNormal;
+            normals[face.z] += facetNormal;
+        } else {
+            float angles[3];
+            vec3 facetNormal = ComputeFacetNormal(positions, face, angles);
+            normals[face.x] += facetNormal * angles[0];
+            normals[face.y] += facetNormal * angles[1];
+            normals[face.z] += facetNormal * angles[2];
+        }
+    }
+}
+
+// The plain serial scatter, for small meshes and single cores.
+static void ScatterVertexNormals(const vector<vec3>& positions, const vector<ivec3>& faces, vector<vec3>& normals,
+                                 NormalWeighting weighting)
+{
+    normals.assign(positions.size(), vec3(0, 0, 0));
+    if (!normals.empty())
+        ScatterFaces(positions, faces, 0, faces.size(), weighting, &normals[0]);
+    for (size_t v = 0; v < normals.size(); ++v)
+        normals[v].Normalize();
+}
+
+// The vertices a block of faces touches, from First to End. Meshes keep
+// neighboring faces near each other and on nearby vertices, so a block's
+// span tends to be a small part of the mesh.
+struct VertexSpan {
+    int First;
+    int End;
+};
+
+// Each thread scatters one contiguous block of faces into sums of its own:
+// the first block into the normals themselves, the others into their rows of
+// Partials, of which only the block's span is cleared and written. Every face
+// is read by one thread, and no two threads write the same sum.
+struct ScatterBlockTask {
+    const vector<vec3>* Positions;
+    const vector<ivec3>* Faces;
+    NormalWeighting Weighting;
+    int BlockCount;
+    vec3* Normals;
+    vec3* Partials; // BlockCount - 1 rows of one sum per vertex
+    VertexSpan* Spans; // By block
+    int VertexCount;
+    void operator()(int block)
+    {
+        int faceCount = Faces->size();
+        int firstFace = (int) ((long long) faceCount * block / BlockCount);
+        int endFace = (int) ((long long) faceCount * (block + 1) / BlockCount);
+        VertexSpan span = { VertexCount, 0 };
+        if (block == 0) {
+            span.First = 0;
+            span.End = VertexCount;
+        } else {
+            for (int faceIndex = firstFace; faceIndex < endFace; ++faceIndex) {
+                const ivec3& face = (*Faces)[faceIndex];
+                span.First = min(span.First, min(face.x, min(face.y, face.z)));
+                span.End = max(span.End, max(face.x, max(face.y, face.z)) + 1);
+            }
+        }
+        Spans[block] = span;
+        if (span.First >= span.End)
+            return;
+        
+        vec3* sums = block == 0 ? Normals : Partials + (block - 1) * VertexCount;
+        fill(sums + span.First, sums + span.End, vec3(0, 0, 0));
+        ScatterFaces(*Positions, *Faces, firstFace, endFace, Weighting, sums);
+    }
+};
+
+// Adds the other blocks' sums to the first block's, in block order, over
+// one range of vertices, and normalizes.
+struct ReduceNormalTask {
+    int BlockCount;
+    vec3* Normals;
+    const vec3* Partials;
+    const VertexSpan* Spans;
+    int VertexCount;
+    void operator()(int range)
+    {
+        int first = (int) ((long long) VertexCount * range / BlockCount);
+        int end = (int) ((long long) VertexCount * (range + 1) / BlockCount);
+        for (int block = 1; block < BlockCount; ++block) {
+            const vec3* partials = Partials + (block - 1) * VertexCount;
+            int spanFirst = max(first, Spans[block].First);
+            int spanEnd = min(end, Spans[block].End);
+            for (int v = spanFirst; v < spanEnd; ++v)
+                Normals[v] += partials[v];
+        }
+        for (int v = first; v < end; ++v)
+            Normals[v].Normalize();
+    }
+};
+
+void GenerateVertexNormals(const vector<vec3>& positions, const vector<ivec3>& faces, vector<vec3>& normals,
+                           NormalWeighting weighting, int maxThreads)
+{
+    int vertexCount = positions.size();
+    int faceCount = faces.size();
+    int blockCount = maxThreads > 0 ? maxThreads : GetCoreCount();
+    if (faceCount < MinParallelFaces || blockCount > vertexCount)
+        blockCount = 1;
+    if (blockCount == 1) {
+        ScatterVertexNormals(positions, faces, normals, weighting);
+        return;
+    }
+    
+    // Left uninitialized, so the memory outside the blocks' spans is never touched
+    normals.resize(vertexCount);
+    vec3* partials = new vec3[(blockCount - 1) * vertexCount];
+    vector<VertexSpan> spans(blockCount);
+    ScatterBlockTask scatterTask = {
+        &positions, &faces, weighting, blockCount, &normals[0], partials, &spans[0], vertexCount
+    };
+    ParallelFor(blockCount, scatterTask, maxThreads);
+    ReduceNormalTask reduceTask = { blockCount, &normals[0], partials, &spans[0], vertexCount };
+    ParallelFor(blockCount, reduceTask, maxThreads);
+    delete[] partials;
+}
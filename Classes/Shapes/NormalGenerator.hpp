@@ -0,0 +1,28 @@
+//
+//  NormalGenerator.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_NormalGenerator_h
+#define ModelViewer_NormalGenerator_h
+
+#include "Interfaces.hpp"
+
+// How much each adjoining triangle contributes to a vertex normal.
+enum NormalWeighting {
+    NormalWeightingArea,  // By the triangle's area, as summing the raw facet normals does
+    NormalWeightingAngle  // By the triangle's angle at the vertex (Thurmer & Wuthrich)
+};
+
+// Smooth per-vertex normals for an indexed triangle list. Rather than
+// scattering facet normals into shared vertices from every thread, each of up
+// to maxThreads threads (0 means one per core) scatters one block of faces
+// into sums of its own, and the sums are then added up over ranges of
+// vertices, so there are no write conflicts and every face is read once
+// however many threads run. Small meshes and single cores get the plain
+// serial scatter. The sums are added in block order, so a given thread count
+// always gives the same normals; other counts differ only by rounding.
+void GenerateVertexNormals(const vector<vec3>& positions, const vector<ivec3>& faces, vector<vec3>& normals,
+                           NormalWeighting weighting = NormalWeightingArea, int maxThreads = 0);
+
+#endif
@@ -0,0 +1,305 @@
+//
+//  ObjParser.cpp
+//  ModelViewer
+//
+
+#include "ObjParser.hpp"
+#include "Parallel.hpp"
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+static const float PowersOfTen[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+// Largest exponent and mantissa for which both operands of the final
+// multiply or divide are exact floats, so the result is correctly rounded.
+static const int MaxFastExponent = 10;
+static const unsigned long long MaxFastMantissa = 1 << 24;
+
+// Below this many bytes per thread, spawning threads costs more than it saves.
+static const size_t MinChunkSize = 256 * 1024;
+
+struct ObjChunk {
+    const char* Begin;
+    const char* End;
+    ObjData Data;
+    size_t PositionOffset;
+    size_t TexCoordOffset;
+    size_t NormalOffset;
+    size_t CornerOffset;
+};
+
+static inline bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline bool IsDigit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline void SkipBlanks(const char*& cursor, const char* end)
+{
+    while (cursor != end && IsBlank(*cursor))
+        ++cursor;
+}
+
+float ParseFloat(const char*& cursor, const char* end)
+{
+    SkipBlanks(cursor, end);
+    const char* start = cursor;
+    const char* p = cursor;
+    
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    
+    // Accumulate the significant digits as an integer and remember where the point was.
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    for (; p != end && IsDigit(*p); ++p, ++digits)
+        mantissa = mantissa * 10 + (*p - '0');
+    if (p != end && *p == '.') {
+        for (++p; p != end && IsDigit(*p); ++p, ++digits, --exponent)
+            mantissa = mantissa * 10 + (*p - '0');
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e != end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if (e != end && IsDigit(*e)) {
+            int value = 0;
+            for (; e != end && IsDigit(*e); ++e)
+                value = value < 10000 ? value * 10 + (*e - '0') : value;
+            exponent += negativeExponent ? -value : value;
+            p = e;
+        }
+    }
+    cursor = p;
+    
+    // Trailing zeros of the fraction do not change the value.
+    while (exponent < 0 && mantissa != 0 && mantissa % 10 == 0) {
+        mantissa /= 10;
+        ++exponent;
+    }
+    
+    if (digits < 19 && mantissa <= MaxFastMantissa &&
+        exponent >= -MaxFastExponent && exponent <= MaxFastExponent) {
+        float value = (float) mantissa;
+        if (exponent < 0)
+            value /= PowersOfTen[-exponent];
+        else
+            value *= PowersOfTen[exponent];
+        return negative ? -value : value;
+    }
+    
+    // Too many digits for the fast path; let the C library round it.
+    string token(start, p);
+    return strtof(token.c_str(), 0);
+}
+
+int ParseInt(const char*& cursor, const char* end)
+{
+    SkipBlanks(cursor, end);
+    bool negative = false;
+    if (cursor != end && (*cursor == '-' || *cursor == '+'))
+        negative = *cursor++ == '-';
+    int value = 0;
+    for (; cursor != end && IsDigit(*cursor); ++cursor)
+        value = value * 10 + (*cursor - '0');
+    return negative ? -value : value;
+}
+
+// Converts a one-based (or negative, relative) OBJ index to a zero-based one.
+// Relative indices resolve against count and set flag in relativeAttributes.
+static inline int ResolveIndex(int index, size_t count, unsigned char flag, unsigned char& relativeAttributes)
+{
+    if (index > 0)
+        return index - 1;
+    if (index == 0)
+        return -1;
+    relativeAttributes |= flag;
+    return (int) count + index;
+}
+
+static void ParseFace(const char* cursor, const char* end, ObjData& data, vector<ObjCorner>& polygon, vector<unsigned char>& relative)
+{
+    polygon.clear();
+    relative.clear();
+    for (;;) {
+        SkipBlanks(cursor, end);
+        if (cursor == end || !(IsDigit(*cursor) || *cursor == '-' || *cursor == '+'))
+            break;
+        
+        int position = ParseInt(cursor, end);
+        int texCoord = 0;
+        int normal = 0;
+        if (cursor != end && *cursor == '/') {
+            ++cursor;
+            if (cursor != end && *cursor != '/')
+                texCoord = ParseInt(cursor, end);
+            if (cursor != end && *cursor == '/') {
+                ++cursor;
+                normal = ParseInt(cursor, end);
+            }
+        }
+        
+        unsigned char attributes = 0;
+        ObjCorner corner;
+        corner.Position = ResolveIndex(position, data.Positions.size(), ObjAttributePosition, attributes);
+        corner.TexCoord = ResolveIndex(texCoord, data.TexCoords.size(), ObjAttributeTexCoord, attributes);
+        corner.Normal = ResolveIndex(normal, data.Normals.size(), ObjAttributeNormal, attributes);
+        polygon.push_back(corner);
+        relative.push_back(attributes);
+    }
+    
+    // Triangulate as a fan around the first corner.
+    for (size_t i = 2; i < polygon.size(); ++i) {
+        size_t triangle[3] = { 0, i - 1, i };
+        for (int j = 0; j < 3; ++j) {
+            if (relative[triangle[j]]) {
+                ObjRelativeCorner entry = { data.Corners.size(), relative[triangle[j]] };
+                data.RelativeCorners.push_back(entry);
+            }
+            data.Corners.push_back(polygon[triangle[j]]);
+        }
+    }
+}
+
+void ParseObj(const char* begin, const char* end, ObjData& data)
+{
+    vector<ObjCorner> polygon;
+    vector<unsigned char> relative;
+    const char* line = begin;
+    while (line < end) {
+        // memchr is vectorized by the C library, so this is the fast way to find the next line.
+        const char* newline = (const char*) memchr(line, '\n', end - line);
+        const char* lineEnd = newline ? newline : end;
+        
+        if (lineEnd - line > 1 && IsBlank(line[1])) {
+            const char* cursor = line + 1;
+            if (line[0] == 'v') {
+                vec3 position;
+                position.x = ParseFloat(cursor, lineEnd);
+                position.y = ParseFloat(cursor, lineEnd);
+                position.z = ParseFloat(cursor, lineEnd);
+                data.Positions.push_back(position);
+            } else if (line[0] == 'f') {
+                ParseFace(cursor, lineEnd, data, polygon, relative);
+            }
+        } else if (lineEnd - line > 2 && line[0] == 'v' && IsBlank(line[2])) {
+            const char* cursor = line + 2;
+            if (line[1] == 'n') {
+                vec3 normal;
+                normal.x = ParseFloat(cursor, lineEnd);
+                normal.y = ParseFloat(cursor, lineEnd);
+                normal.z = ParseFloat(cursor, lineEnd);
+                data.Normals.push_back(normal);
+            } else if (line[1] == 't') {
+                vec2 texCoord;
+                texCoord.x = ParseFloat(cursor, lineEnd);
+                texCoord.y = ParseFloat(cursor, lineEnd);
+                data.TexCoords.push_back(texCoord);
+            }
+        }
+        line = lineEnd + 1;
+    }
+}
+
+struct ParseChunkTask {
+    vector<ObjChunk>* Chunks;
+    void operator()(int index)
+    {
+        ObjChunk& chunk = (*Chunks)[index];
+        ParseObj(chunk.Begin, chunk.End, chunk.Data);
+    }
+};
+
+struct CopyChunkTask {
+    vector<ObjChunk>* Chunks;
+    ObjData* Data;
+    void operator()(int index)
+    {
+        ObjChunk& chunk = (*Chunks)[index];
+        ObjData& source = chunk.Data;
+        
+        // Relative indices were resolved against the chunk alone; rebase them.
+        for (size_t i = 0; i < source.RelativeCorners.size(); ++i) {
+            const ObjRelativeCorner& relative = source.RelativeCorners[i];
+            ObjCorner& corner = source.Corners[relative.Corner];
+            if (relative.Attributes & ObjAttributePosition)
+                corner.Position += chunk.PositionOffset;
+            if (relative.Attributes & ObjAttributeTexCoord)
+                corner.TexCoord += chunk.TexCoordOffset;
+            if (relative.Attributes & ObjAttributeNormal)
+                corner.Normal += chunk.NormalOffset;
+        }
+        
+        copy(source.Positions.begin(), source.Positions.end(), Data->Positions.begin() + chunk.PositionOffset);
+        copy(source.TexCoords.begin(), source.TexCoords.end(), Data->TexCoords.begin() + chunk.TexCoordOffset);
+        copy(source.Normals.begin(), source.Normals.end(), Data->Normals.begin() + chunk.NormalOffset);
+        copy(source.Corners.begin(), source.Corners.end(), Data->Corners.begin() + chunk.CornerOffset);
+    }
+};
+
+void ParseObjParallel(const char* begin, const char* end, ObjData& data, int maxThreads)
+{
+    size_t size = end - begin;
+    int chunkCount = maxThreads > 0 ? maxThreads : GetCoreCount();
+    if ((size_t) chunkCount > size / MinChunkSize)
+        chunkCount = (int) (size / MinChunkSize);
+    if (chunkCount < 2) {
+        ParseObj(begin, end, data);
+        return;
+    }
+    
+    // Split into roughly equal chunks, moving each split point past the next newline.
+    vector<ObjChunk> chunks(chunkCount);
+    const char* chunkBegin = begin;
+    for (int i = 0; i < chunkCount; ++i) {
+        const char* chunkEnd = end;
+        if (i < chunkCount - 1) {
+            chunkEnd = begin + size * (i + 1) / chunkCount;
+            if (chunkEnd < chunkBegin)
+                chunkEnd = chunkBegin;
+            const char* newline = (const char*) memchr(chunkEnd, '\n', end - chunkEnd);
+            chunkEnd = newline ? newline + 1 : end;
+        }
+        chunks[i].Begin = chunkBegin;
+        chunks[i].End = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+    
+    ParseChunkTask parse = { &chunks };
+    ParallelFor(chunkCount, parse, maxThreads);
+    
+    // Prefix sum of the per-chunk counts gives each chunk's place in the output.
+    size_t positionCount = data.Positions.size();
+    size_t texCoordCount = data.TexCoords.size();
+    size_t normalCount = data.Normals.size();
+    size_t cornerCount = data.Corners.size();
+    for (int i = 0; i < chunkCount; ++i) {
+        const ObjData& source = chunks[i].Data;
+        chunks[i].PositionOffset = positionCount;
+        chunks[i].TexCoordOffset = texCoordCount;
+        chunks[i].NormalOffset = normalCount;
+        chunks[i].CornerOffset = cornerCount;
+        positionCount += source.Positions.size();
+        texCoordCount += source.TexCoords.size();
+        normalCount += source.Normals.size();
+        cornerCount += source.Corners.size();
+    }
+    data.Positions.resize(positionCount);
+    data.TexCoords.resize(texCoordCount);
+    data.Normals.resize(normalCount);
+    data.Corners.resize(cornerCount);
+    
+    CopyChunkTask stitch = { &chunks, &data };
+    ParallelFor(chunkCount, stitch, maxThreads);
+}
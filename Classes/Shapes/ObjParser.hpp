@@ -0,0 +1,53 @@
+//
+//  ObjParser.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_ObjParser_h
+#define ModelViewer_ObjParser_h
+
+#include "Interfaces.hpp"
+
+enum ObjAttributeFlags {
+    ObjAttributePosition = 1 << 0,
+    ObjAttributeTexCoord = 1 << 1,
+    ObjAttributeNormal = 1 << 2,
+};
+
+// One corner of a face. Indices are zero-based; -1 marks an attribute the face leaves out.
+struct ObjCorner {
+    int Position;
+    int TexCoord;
+    int Normal;
+};
+
+// A corner that used negative (relative) indices in the file, with the attributes concerned.
+struct ObjRelativeCorner {
+    size_t Corner;
+    unsigned char Attributes;
+};
+
+struct ObjData {
+    vector<vec3> Positions;
+    vector<vec2> TexCoords;
+    vector<vec3> Normals;
+    vector<ObjCorner> Corners; // Three per triangle; polygons are fan triangulated.
+    vector<ObjRelativeCorner> RelativeCorners;
+};
+
+// Appends the v, vt, vn and f records found between begin and end to data.
+// Faces may use any of the p, p/t, p//n and p/t/n forms with positive or
+// negative indices. Other records are skipped.
+void ParseObj(const char* begin, const char* end, ObjData& data);
+
+// Same result as ParseObj, but the input is split into chunks at line boundaries
+// and the chunks are parsed concurrently (maxThreads = 0 uses every core).
+// Inputs too small to benefit are parsed on the calling thread.
+void ParseObjParallel(const char* begin, const char* end, ObjData& data, int maxThreads = 0);
+
+// Locale-independent number parsing. Leading blanks are skipped and cursor
+// is left just past the token.
+float ParseFloat(const char*& cursor, const char* end);
+int ParseInt(const char*& cursor, const char* end);
+
+#endif
@@ -7,112 +7,163 @@
 //
 
 #include "ObjSurface.hpp"
-#import <list>
-#import <fstream>
-#import <assert.h>
+#include "ObjParser.hpp"
+#include "MappedFile.hpp"
+#include "MeshSplit.hpp"
+#include <assert.h>
 
 using namespace std;
 
-ObjSurface::ObjSurface(const string& name) :
-m_name(name),
-m_faceCount(0),
-m_vertexCount(0)
-{
-    m_faces.resize(GetTriangleIndexCount() / 3);
-    ifstream objFile(m_name.c_str());
-    vector<ivec3>::iterator face = m_faces.begin();
-    int i = 0;
-    while (objFile) {
-        char c = objFile.get();
-        if (c == 'f') {
-            assert(face != m_faces.end() && "parse error");
-            objFile >> face->x >> face->y >> face->z;
-            *face++ -= ivec3(1, 1, 1);
-            i++;
+// Open-addressing (linear probing) map from a corner's attribute tuple to the
+// vertex created for it, so corners shared between faces stay a single vertex.
+class CornerIndexMap {
+public:
+    CornerIndexMap(size_t maxCount)
+    {
+        size_t capacity = 16;
+        while (capacity < maxCount * 2)
+            capacity *= 2;
+        Entry empty = { { 0, 0, 0 }, -1 };
+        m_entries.resize(capacity, empty);
+        m_mask = capacity - 1;
+    }
+    // Returns the vertex for corner, or assigns it nextIndex if the tuple is new.
+    int Insert(const ObjCorner& corner, int nextIndex)
+    {
+        unsigned int hash = corner.Position * 73856093u ^ corner.TexCoord * 19349663u ^ corner.Normal * 83492791u;
+        size_t slot = (hash * 2654435761u) & m_mask;
+        for (;; slot = (slot + 1) & m_mask) {
+            Entry& entry = m_entries[slot];
+            if (entry.Value == -1) {
+                entry.Key = corner;
+                entry.Value = nextIndex;
+                return nextIndex;
+            }
+            if (entry.Key.Position == corner.Position &&
+                entry.Key.TexCoord == corner.TexCoord &&
+                entry.Key.Normal == corner.Normal)
+                return entry.Value;
         }
-        objFile.ignore(MaxLineSize, '\n');
     }
-    assert(face == m_faces.end() && "parse error");
-}
+private:
+    struct Entry {
+        ObjCorner Key;
+        int Value;
+    };
+    vector<Entry> m_entries;
+    size_t m_mask;
+};
 
-int ObjSurface::GetVertexCount() const
+ObjSurface::ObjSurface(const string& name, NormalWeighting normalWeighting) :
+m_name(name),
+m_normalWeighting(normalWeighting)
 {
-    if (m_vertexCount != 0)
-    return m_vertexCount;
+    // Read every record in a single pass over the mapped file.
+    ObjData obj;
+    {
+        MappedFile objFile(m_name);
+        ParseObjParallel(objFile.Begin(), objFile.End(), obj);
+    }
     
-    ifstream objFile(m_name.c_str());
-    while (objFile) {
-        char c = objFile.get();
-        if (c == 'v')
-        m_vertexCount++;
-        objFile.ignore(MaxLineSize, '\n');
+    // The file's normals are only usable if every corner refers to one.
+    bool useNormals = !obj.Normals.empty();
+    bool useTexCoords = !obj.TexCoords.empty();
+    for (vector<ObjCorner>::const_iterator c = obj.Corners.begin(); c != obj.Corners.end(); ++c) {
+        if (c->Normal < 0)
+            useNormals = false;
+        if (c->TexCoord < 0)
+            useTexCoords = false;
     }
-    return m_vertexCount;
-}
-
-int ObjSurface::GetTriangleIndexCount() const
-{
-    if (m_faceCount != 0)
-    return m_faceCount * 3;
     
-    ifstream objFile(m_name.c_str());
-    while (objFile) {
-        char c = objFile.get();
-        if (c == 'f')
-        m_faceCount++;
-        objFile.ignore(MaxLineSize, '\n');
+    m_faces.resize(obj.Corners.size() / 3);
+    int* index = m_faces.empty() ? 0 : &m_faces[0].x;
+    
+    // With positions only, each position is a vertex, in file order.
+    if (!useNormals && !useTexCoords) {
+        m_positions.swap(obj.Positions);
+        for (vector<ObjCorner>::const_iterator c = obj.Corners.begin(); c != obj.Corners.end(); ++c) {
+            assert(c->Position >= 0 && c->Position < GetVertexCount() && "parse error");
+            *index++ = c->Position;
+        }
+        return;
+    }
+    
+    // Otherwise each distinct position/texcoord/normal tuple becomes one vertex.
+    CornerIndexMap vertices(obj.Corners.size());
+    for (vector<ObjCorner>::const_iterator c = obj.Corners.begin(); c != obj.Corners.end(); ++c) {
+        ObjCorner corner = *c;
+        if (!useNormals)
+            corner.Normal = -1;
+        if (!useTexCoords)
+            corner.TexCoord = -1;
+        int vertex = vertices.Insert(corner, GetVertexCount());
+        if (vertex == GetVertexCount()) {
+            assert(corner.Position >= 0 && corner.Position < (int) obj.Positions.size() && "parse error");
+            m_positions.push_back(obj.Positions[corner.Position]);
+            if (useNormals) {
+                assert(corner.Normal < (int) obj.Normals.size() && "parse error");
+                m_normals.push_back(obj.Normals[corner.Normal]);
+            }
+            if (useTexCoords) {
+                assert(corner.TexCoord < (int) obj.TexCoords.size() && "parse error");
+                m_texCoords.push_back(obj.TexCoords[corner.TexCoord]);
+            }
+        }
+        *index++ = vertex;
     }
-    return m_faceCount * 3;
 }
 
 void ObjSurface::GenerateVertices(vector<float>& floats, unsigned char flags) const
 {
-    assert(flags == VertexFlagsNormal && "Unsupported flags.");
-    
-    struct Vertex {
-        vec3 Position;
-        vec3 Normal;
-    };
+    bool useNormals = flags & VertexFlagsNormal;
+    bool useTexCoords = flags & VertexFlagsTexCoords;
     
-    // Read in the vertex positions and initialize lighting normals to (0, 0, 0).
-    floats.resize(GetVertexCount() * 6);
-    ifstream objFile(m_name.c_str());
-    Vertex* vertex = (Vertex*) &floats[0];
-    while (objFile) {
-        char c = objFile.get();
-        if (c == 'v') {
-            vertex->Normal = vec3(0, 0, 0);
-            vec3& position = (vertex++)->Position;
-            objFile >> position.x >> position.y >> position.z;
-        }
-        objFile.ignore(MaxLineSize, '\n');
+    // Prefer the normals given by the file; smooth normals are computed otherwise.
+    vector<vec3> computedNormals;
+    const vector<vec3>* normals = &m_normals;
+    if (useNormals && m_normals.empty()) {
+        GenerateVertexNormals(m_positions, m_faces, computedNormals, m_normalWeighting);
+        normals = &computedNormals;
     }
     
-    vertex = (Vertex*) &floats[0];
-    for (size_t faceIndex = 0; faceIndex < m_faces.size(); ++faceIndex) {
-        ivec3 face = m_faces[faceIndex];
-        
-        // Compute the facet normal.
-        vec3 a = vertex[face.x].Position;
-        vec3 b = vertex[face.y].Position;
-        vec3 c = vertex[face.z].Position;
-        vec3 facetNormal = (b - a).Cross(c - a);
-        
-        // Add the facet normal to the lighting normal of each adjoining vertex.
-        vertex[face.x].Normal += facetNormal;
-        vertex[face.y].Normal += facetNormal;
-        vertex[face.z].Normal += facetNormal;
+    int floatsPerVertex = 3;
+    if (useNormals)
+        floatsPerVertex += 3;
+    if (useTexCoords)
+        floatsPerVertex += 2;
+    int vertexCount = GetVertexCount();
+    floats.resize(vertexCount * floatsPerVertex);
+    float* attribute = floats.empty() ? 0 : &floats[0];
+    for (int v = 0; v < vertexCount; ++v) {
+        vec3 position = m_positions[v];
+        attribute = position.Write(attribute);
+        if (useNormals) {
+            vec3 normal = (*normals)[v];
+            attribute = normal.Write(attribute);
+        }
+        if (useTexCoords) {
+            vec2 texCoord = m_texCoords.empty() ? vec2(0, 0) : m_texCoords[v];
+            attribute = texCoord.Write(attribute);
+        }
     }
-    
-    // Normalize the normals.
-    for (int v = 0; v < GetVertexCount(); ++v)
-    vertex[v].Normal.Normalize();
 }
 
 void ObjSurface::GenerateTriangleIndices(vector<unsigned short>& indices) const
+{
+    assert(GetVertexCount() <= MaxShortIndexVertices && "Too many vertices for 16-bit indices.");
+    GenerateTriangleIndexList(indices);
+}
+
+void ObjSurface::GenerateTriangleIndices(vector<unsigned int>& indices) const
+{
+    GenerateTriangleIndexList(indices);
+}
+
+template <typename Index>
+void ObjSurface::GenerateTriangleIndexList(vector<Index>& indices) const
 {
     indices.resize(GetTriangleIndexCount());
-    vector<unsigned short>::iterator index = indices.begin();
+    typename vector<Index>::iterator index = indices.begin();
     for (vector<ivec3>::const_iterator f = m_faces.begin(); f != m_faces.end(); ++f) {
         *index++ = f->x;
         *index++ = f->y;
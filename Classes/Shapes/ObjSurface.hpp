@@ -1,18 +1,23 @@
 #include "Interfaces.hpp"
+#include "NormalGenerator.hpp"
 
 class ObjSurface : public ISurface {
 public:
-    ObjSurface(const string& name);
-    int GetVertexCount() const;
+    ObjSurface(const string& name, NormalWeighting normalWeighting = NormalWeightingArea);
+    int GetVertexCount() const { return m_positions.size(); }
     int GetLineIndexCount() const { return 0; }
-    int GetTriangleIndexCount() const;
+    int GetTriangleIndexCount() const { return m_faces.size() * 3; }
     void GenerateVertices(vector<float>& vertices, unsigned char flags) const;
     void GenerateLineIndices(vector<unsigned short>& indices) const {}
     void GenerateTriangleIndices(vector<unsigned short>& indices) const;
+    void GenerateTriangleIndices(vector<unsigned int>& indices) const;
 private:
+    template <typename Index>
+    void GenerateTriangleIndexList(vector<Index>& indices) const;
     string m_name;
+    NormalWeighting m_normalWeighting; // For normals computed when the file has none
+    vector<vec3> m_positions;
+    vector<vec3> m_normals; // From the file's vn records; empty when they must be computed.
+    vector<vec2> m_texCoords;
     vector<ivec3> m_faces;
-    mutable size_t m_faceCount;
-    mutable size_t m_vertexCount;
-    static const int MaxLineSize = 128;
 };
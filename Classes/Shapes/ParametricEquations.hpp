@@ -1,4 +1,5 @@
 #include "ParametricSurface.hpp"
+#include "SinCos.hpp"
 
 class Cone : public ParametricSurface {
 public:
@@ -35,6 +36,18 @@ public:
         float z = m_radius * -sin(u) * sin(v);
         return vec3(x, y, z);
     }
+    void EvaluateBatch(int count, const float* u, const float* v, float* x, float* y, float* z) const
+    {
+        float sinU[EvaluateBatchSize], cosU[EvaluateBatchSize];
+        float sinV[EvaluateBatchSize], cosV[EvaluateBatchSize];
+        SinCos(u, sinU, cosU, count);
+        SinCos(v, sinV, cosV, count);
+        for (int i = 0; i < count; i++) {
+            x[i] = m_radius * sinU[i] * cosV[i];
+            y[i] = m_radius * cosU[i];
+            z[i] = m_radius * -sinU[i] * sinV[i];
+        }
+    }
 private:
     float m_radius;
 };
@@ -58,6 +71,20 @@ public:
         float z = minor * sin(v);
         return vec3(x, y, z);
     }
+    void EvaluateBatch(int count, const float* u, const float* v, float* x, float* y, float* z) const
+    {
+        const float major = m_majorRadius;
+        const float minor = m_minorRadius;
+        float sinU[EvaluateBatchSize], cosU[EvaluateBatchSize];
+        float sinV[EvaluateBatchSize], cosV[EvaluateBatchSize];
+        SinCos(u, sinU, cosU, count);
+        SinCos(v, sinV, cosV, count);
+        for (int i = 0; i < count; i++) {
+            x[i] = (major + minor * cosV[i]) * cosU[i];
+            y[i] = (major + minor * cosV[i]) * sinU[i];
+            z[i] = minor * sinV[i];
+        }
+    }
 private:
     float m_majorRadius;
     float m_minorRadius;
@@ -101,6 +128,46 @@ public:
         range.z = z + d * ww.z * sin(v);
         return range * m_scale;
     }
+    void EvaluateBatch(int count, const float* domainU, const float* v, float* rangeX, float* rangeY, float* rangeZ) const
+    {
+        const float a = 0.5f;
+        const float b = 0.3f;
+        const float c = 0.5f;
+        const float d = 0.1f;
+        float u[EvaluateBatchSize], u15[EvaluateBatchSize];
+        for (int i = 0; i < count; i++) {
+            u[i] = (TwoPi - domainU[i]) * 2;
+            u15[i] = 1.5f * u[i];
+        }
+        float sinU[EvaluateBatchSize], cosU[EvaluateBatchSize];
+        float sinU15[EvaluateBatchSize], cosU15[EvaluateBatchSize];
+        float sinV[EvaluateBatchSize], cosV[EvaluateBatchSize];
+        SinCos(u, sinU, cosU, count);
+        SinCos(u15, sinU15, cosU15, count);
+        SinCos(v, sinV, cosV, count);
+        for (int i = 0; i < count; i++) {
+            float r = a + b * cosU15[i];
+            float x = r * cosU[i];
+            float y = r * sinU[i];
+            float z = c * sinU15[i];
+            
+            // Unit tangent q, a unit normal to it in the XY plane, and their cross product
+            float dvx = -1.5f * b * sinU15[i] * cosU[i] - r * sinU[i];
+            float dvy = -1.5f * b * sinU15[i] * sinU[i] + r * cosU[i];
+            float dvz = 1.5f * c * cosU15[i];
+            float dvLength = std::sqrt(dvx * dvx + dvy * dvy + dvz * dvz);
+            float qx = dvx / dvLength, qy = dvy / dvLength, qz = dvz / dvLength;
+            float qvnLength = std::sqrt(qy * qy + qx * qx);
+            float qvnx = qy / qvnLength, qvny = -qx / qvnLength;
+            float wwx = -qz * qvny;
+            float wwy = qz * qvnx;
+            float wwz = qx * qvny - qy * qvnx;
+            
+            rangeX[i] = (x + d * (qvnx * cosV[i] + wwx * sinV[i])) * m_scale;
+            rangeY[i] = (y + d * (qvny * cosV[i] + wwy * sinV[i])) * m_scale;
+            rangeZ[i] = (z + d * wwz * sinV[i]) * m_scale;
+        }
+    }
 private:
     float m_scale;
 };
@@ -133,6 +200,28 @@ public:
         range.z = y;
         return range * m_scale;
     }
+    void EvaluateBatch(int count, const float* u, const float* t, float* rangeX, float* rangeY, float* rangeZ) const
+    {
+        float major = 1.25;
+        float a = 0.125f;
+        float b = 0.5f;
+        float phi[EvaluateBatchSize];
+        for (int i = 0; i < count; i++)
+            phi[i] = u[i] / 2;
+        float sinU[EvaluateBatchSize], cosU[EvaluateBatchSize];
+        float sinT[EvaluateBatchSize], cosT[EvaluateBatchSize];
+        float sinPhi[EvaluateBatchSize], cosPhi[EvaluateBatchSize];
+        SinCos(u, sinU, cosU, count);
+        SinCos(t, sinT, cosT, count);
+        SinCos(phi, sinPhi, cosPhi, count);
+        for (int i = 0; i < count; i++) {
+            float x = a * cosT[i] * cosPhi[i] - b * sinT[i] * sinPhi[i];
+            float y = a * cosT[i] * sinPhi[i] + b * sinT[i] * cosPhi[i];
+            rangeX[i] = (major + x) * cosU[i] * m_scale;
+            rangeY[i] = (major + x) * sinU[i] * m_scale;
+            rangeZ[i] = y * m_scale;
+        }
+    }
 private:
     float m_scale;
 };
@@ -7,6 +7,20 @@
 //
 
 #include "ParametricSurface.hpp"
+#include "Parallel.hpp"
+#include "MeshSplit.hpp"
+#include <algorithm>
+#include <assert.h>
+
+// Surfaces with fewer vertices than this are generated on the calling thread only.
+static const int MinParallelVertices = 4096;
+
+struct VertexRowContext {
+    const ParametricSurface* Surface;
+    float* Vertices;
+    int FloatsPerRow;
+    bool UseNormals;
+};
 
 void ParametricSurface::SetInterval(const ParametricInterval &interval) {
     m_upperBound = interval.UpperBound;
@@ -31,6 +45,15 @@ vec2 ParametricSurface::ComputeDomain(float x, float y) const {
                 y * m_upperBound.y / m_slices.y);
 }
 
+void ParametricSurface::EvaluateBatch(int count, const float* u, const float* v, float* x, float* y, float* z) const {
+    for (int i = 0; i < count; i++) {
+        vec3 range = Evaluate(vec2(u[i], v[i]));
+        x[i] = range.x;
+        y[i] = range.y;
+        z[i] = range.z;
+    }
+}
+
 void ParametricSurface::GenerateVertices(vector<float>& vertices, unsigned char flags) const {
     int floatPerVertex = 3;
     bool useNormals = flags & VertexFlagsNormal;
@@ -38,31 +61,68 @@ void ParametricSurface::GenerateVertices(vector<float>& vertices, unsigned char
         floatPerVertex += 3;
     }
     vertices.resize(GetVertexCount() * floatPerVertex);
-    float * attribute = (float *)&vertices[0];
-    for (int j = 0; j < m_divisions.y; j++) {
-        for (int i = 0; i < m_divisions.x; i++) {
-            
-            // Compute Position
+    
+    // Rows are independent, so big surfaces spread them over the cores
+    VertexRowContext context = { this, &vertices[0], m_divisions.x * floatPerVertex, useNormals };
+    int maxThreads = GetVertexCount() < MinParallelVertices ? 1 : 0;
+    ParallelFor(m_divisions.y, GenerateVertexRowTask, &context, maxThreads);
+}
+
+void ParametricSurface::GenerateVertexRowTask(void* context, int row) {
+    const VertexRowContext& rows = *(const VertexRowContext*) context;
+    rows.Surface->GenerateVertexRow(row, rows.Vertices + row * rows.FloatsPerRow, rows.UseNormals);
+}
+
+void ParametricSurface::GenerateVertexRow(int j, float* attribute, bool useNormals) const {
+    // Sample sets: the position, then the three points of the normal's finite differences
+    enum { Position, Base, AlongU, AlongV, SampleSets };
+    float u[SampleSets][EvaluateBatchSize], v[SampleSets][EvaluateBatchSize];
+    float x[SampleSets][EvaluateBatchSize], y[SampleSets][EvaluateBatchSize], z[SampleSets][EvaluateBatchSize];
+    int sampleSets = useNormals ? SampleSets : 1;
+    
+    for (int first = 0; first < m_divisions.x; first += EvaluateBatchSize) {
+        int count = std::min(EvaluateBatchSize, m_divisions.x - first);
+        for (int k = 0; k < count; k++) {
+            int i = first + k;
             vec2 domain = ComputeDomain(i, j);
-            vec3 range = Evaluate(domain);
+            u[Position][k] = domain.x;
+            v[Position][k] = domain.y;
+            if (!useNormals)
+                continue;
+            
+            float s = i, t = j;
+            
+            // Nudge the point if the normal is indeterminate
+            if (i == 0) s += 0.01;
+            if (i == m_divisions.x - 1) s -= 0.01;
+            if (j == 0) t += 0.01f;
+            if (j == m_divisions.y - 1) t -= 0.01;
+            
+            vec2 base = ComputeDomain(s, t);
+            vec2 alongU = ComputeDomain(s + 0.01, t);
+            vec2 alongV = ComputeDomain(s, t + 0.01);
+            u[Base][k] = base.x;
+            v[Base][k] = base.y;
+            u[AlongU][k] = alongU.x;
+            v[AlongU][k] = alongU.y;
+            u[AlongV][k] = alongV.x;
+            v[AlongV][k] = alongV.y;
+        }
+        for (int set = 0; set < sampleSets; set++)
+            EvaluateBatch(count, u[set], v[set], x[set], y[set], z[set]);
+        
+        for (int k = 0; k < count; k++) {
+            // Position
+            vec3 range(x[Position][k], y[Position][k], z[Position][k]);
             attribute = range.Write(attribute);
             
-            // Compute Normal
+            // Compute the tangent and their cross product
             if (useNormals) {
-                float s = i, t = j;
-                
-                // Nudge the point if the normal is indeterminate
-                if (i == 0) s += 0.01;
-                if (i == m_divisions.x - 1) s -= 0.01;
-                if (j == 0) t += 0.01f;
-                if (j == m_divisions.y - 1) t -= 0.01;
-                
-                // Compute the tangent and their cross product
-                vec3 p = Evaluate(ComputeDomain(s, t));
-                vec3 u = Evaluate(ComputeDomain(s + 0.01, t)) - p;
-                vec3 v = Evaluate(ComputeDomain(s, t + 0.01)) - p;
-                vec3 normal = u.Cross(v).Normalized();
-                if (InvertNormal(domain))
+                vec3 p(x[Base][k], y[Base][k], z[Base][k]);
+                vec3 du = vec3(x[AlongU][k], y[AlongU][k], z[AlongU][k]) - p;
+                vec3 dv = vec3(x[AlongV][k], y[AlongV][k], z[AlongV][k]) - p;
+                vec3 normal = du.Cross(dv).Normalized();
+                if (InvertNormal(vec2(u[Position][k], v[Position][k])))
                     normal = -normal;
                 attribute = normal.Write(attribute);
             }
@@ -71,6 +131,7 @@ void ParametricSurface::GenerateVertices(vector<float>& vertices, unsigned char
 }
 
 void ParametricSurface::GenerateLineIndices(vector<unsigned short>& indices) const {
+    assert(GetVertexCount() <= MaxShortIndexVertices && "Too many vertices for 16-bit indices.");
     indices.resize(GetLineIndexCount());
     vector<unsigned short>::iterator index = indices.begin();
     for (int j = 0, vertex = 0; j < m_slices.y; j++) {
@@ -86,8 +147,18 @@ void ParametricSurface::GenerateLineIndices(vector<unsigned short>& indices) con
 }
 
 void ParametricSurface::GenerateTriangleIndices(vector<unsigned short> &indices) const {
+    assert(GetVertexCount() <= MaxShortIndexVertices && "Too many vertices for 16-bit indices.");
+    GenerateTriangleIndexList(indices);
+}
+
+void ParametricSurface::GenerateTriangleIndices(vector<unsigned int> &indices) const {
+    GenerateTriangleIndexList(indices);
+}
+
+template <typename Index>
+void ParametricSurface::GenerateTriangleIndexList(vector<Index> &indices) const {
     indices.resize(GetTriangleIndexCount());
-    vector<unsigned short>::iterator index = indices.begin();
+    typename vector<Index>::iterator index = indices.begin();
     for (int j = 0, vertex = 0; j < m_slices.y; ++j) {
         for (int i = 0; i < m_slices.x; ++i) {
             int next = (i+1) % m_divisions.x;
@@ -11,6 +11,10 @@
 
 #include "Interfaces.hpp"
 
+// Most samples passed to EvaluateBatch in one call, so overrides can keep
+// their temporaries on the stack.
+static const int EvaluateBatchSize = 64;
+
 struct ParametricInterval {
     ivec2 Divisions;
     vec2 UpperBound;
@@ -24,11 +28,20 @@ public:
     void GenerateVertices(vector<float>& vertices, unsigned char flags) const;
     void GenerateLineIndices(vector<unsigned short>& indices) const;
     void GenerateTriangleIndices(vector<unsigned short>& indices) const;
+    void GenerateTriangleIndices(vector<unsigned int>& indices) const;
 protected:
     void SetInterval(const ParametricInterval& interval);
     virtual vec3 Evaluate(const vec2& domain) const = 0;
+    // Evaluates count (at most EvaluateBatchSize) domain points at once, from
+    // and into separate arrays per coordinate. Surfaces override this with a
+    // vectorizable version; the default calls Evaluate for each point.
+    virtual void EvaluateBatch(int count, const float* u, const float* v, float* x, float* y, float* z) const;
     virtual bool InvertNormal(const vec2& domain) const {return false;}
 private:
+    static void GenerateVertexRowTask(void* context, int row);
+    void GenerateVertexRow(int row, float* attribute, bool useNormals) const;
+    template <typename Index>
+    void GenerateTriangleIndexList(vector<Index>& indices) const;
     vec2 ComputeDomain(float i, float j) const;
     vec2 m_upperBound;
     ivec2 m_slices;
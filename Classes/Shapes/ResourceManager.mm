@@ -20,6 +20,10 @@ public:
         NSString * bundlePath = [[NSBundle mainBundle] resourcePath];
         return [bundlePath UTF8String];
     }
+    string GetCachePath() const {
+        NSArray * paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+        return [[paths objectAtIndex:0] UTF8String];
+    }
 };
 
 IResourceManager * CreateResourceManager() {
@@ -0,0 +1,66 @@
+//
+//  StagedSurface.cpp
+//  ModelViewer
+//
+
+#include "StagedSurface.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshSplit.hpp"
+#include <algorithm>
+
+using namespace std;
+
+StagedSurface::StagedSurface(ISurface * surface, bool stageIndices) :
+m_surface(surface)
+{
+    const float* vertexData = m_surface->GetVertexData();
+    if (vertexData)
+        m_vertices.assign(vertexData, vertexData + GetVertexCount() * 6);
+    else
+        m_surface->GenerateVertices(m_vertices, VertexFlagsNormal);
+    
+    if (stageIndices && GetVertexCount() > 0 && GetVertexCount() <= MaxShortIndexVertices) {
+        const unsigned short* indexData = m_surface->GetTriangleIndexData();
+        if (indexData) {
+            vector<LodRange> lods;
+            GetLodRanges(*m_surface, lods);
+            m_indices.assign(indexData, indexData + lods.back().FirstIndex + lods.back().IndexCount);
+        } else {
+            ::GenerateLodTriangleIndices(*m_surface, m_indices);
+        }
+    }
+}
+
+StagedSurface::~StagedSurface()
+{
+    delete m_surface;
+}
+
+void StagedSurface::GenerateVertices(vector<float>& vertices, unsigned char flags) const
+{
+    if (flags == VertexFlagsNormal) {
+        vertices = m_vertices;
+        return;
+    }
+    if (flags != 0) {
+        m_surface->GenerateVertices(vertices, flags);
+        return;
+    }
+    
+    // Positions alone
+    vertices.resize(GetVertexCount() * 3);
+    for (int v = 0; v < GetVertexCount(); ++v)
+        copy(&m_vertices[v * 6], &m_vertices[v * 6] + 3, &vertices[v * 3]);
+}
+
+void StagedSurface::GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const
+{
+    if (m_indices.empty()) {
+        m_surface->GenerateLodTriangleIndices(lod, indices);
+        return;
+    }
+    vector<LodRange> lods;
+    GetLodRanges(*this, lods);
+    const unsigned short* first = &m_indices[lods[lod].FirstIndex];
+    indices.assign(first, first + lods[lod].IndexCount);
+}
@@ -0,0 +1,40 @@
+//
+//  StagedSurface.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_StagedSurface_h
+#define ModelViewer_StagedSurface_h
+
+#include "Interfaces.hpp"
+
+// Wraps a surface, generating its vertices with normals up front, and its
+// 16-bit triangle indices for every level of detail if it is small enough
+// for them. They are then served as ready-made data, so neither later
+// processing nor the upload on the drawing thread generates them again.
+// Takes ownership of the wrapped surface.
+class StagedSurface : public ISurface {
+public:
+    StagedSurface(ISurface * surface, bool stageIndices);
+    ~StagedSurface();
+    int GetVertexCount() const { return m_surface->GetVertexCount(); }
+    int GetLineIndexCount() const { return m_surface->GetLineIndexCount(); }
+    int GetTriangleIndexCount() const { return m_surface->GetTriangleIndexCount(); }
+    void GenerateVertices(vector<float>& vertices, unsigned char flags) const;
+    void GenerateLineIndices(vector<unsigned short>& indices) const { m_surface->GenerateLineIndices(indices); }
+    void GenerateTriangleIndices(vector<unsigned short>& indices) const { m_surface->GenerateTriangleIndices(indices); }
+    void GenerateTriangleIndices(vector<unsigned int>& indices) const { m_surface->GenerateTriangleIndices(indices); }
+    int GetLodCount() const { return m_surface->GetLodCount(); }
+    int GetLodTriangleIndexCount(int lod) const { return m_surface->GetLodTriangleIndexCount(lod); }
+    void GenerateLodTriangleIndices(int lod, vector<unsigned int>& indices) const;
+    const float* GetVertexData() const { return m_vertices.empty() ? 0 : &m_vertices[0]; }
+    const unsigned short* GetTriangleIndexData() const { return m_indices.empty() ? 0 : &m_indices[0]; }
+private:
+    StagedSurface(const StagedSurface&);
+    StagedSurface& operator=(const StagedSurface&);
+    ISurface * m_surface;
+    vector<float> m_vertices;
+    vector<unsigned short> m_indices;
+};
+
+#endif
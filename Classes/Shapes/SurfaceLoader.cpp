@@ -0,0 +1,136 @@
+//
+//  SurfaceLoader.cpp
+//  ModelViewer
+//
+
+#include "SurfaceLoader.hpp"
+#include "ObjSurface.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "StagedSurface.hpp"
+
+SurfaceLoader::SurfaceLoader(const string& cacheDirectory) :
+m_cacheDirectory(cacheDirectory),
+m_cancelled(false),
+m_taken(0)
+{
+    pthread_mutex_init(&m_mutex, 0);
+}
+
+SurfaceLoader::~SurfaceLoader()
+{
+    m_cancelled = true;
+    m_graph.Wait();
+    for (size_t i = 0; i < m_surfaces.size(); ++i)
+        delete m_surfaces[i].Surface;
+    pthread_mutex_destroy(&m_mutex);
+}
+
+int SurfaceLoader::AddObjFile(const string& path)
+{
+    LoadingSurface surface = { path, "", 0, 0, false, false, false };
+    m_surfaces.push_back(surface);
+    return m_surfaces.size() - 1;
+}
+
+int SurfaceLoader::AddSurface(ISurface * surface)
+{
+    LoadingSurface loading = { "", "", 0, surface, false, false, false };
+    m_surfaces.push_back(loading);
+    return m_surfaces.size() - 1;
+}
+
+void SurfaceLoader::Start(int maxThreads)
+{
+    for (size_t i = 0; i < m_surfaces.size(); ++i) {
+        int parse = m_graph.AddTask("parse", ParseTask, this, i);
+        int normals = m_graph.AddTask("normals", NormalsTask, this, i);
+        int optimize = m_graph.AddTask("optimize", OptimizeTask, this, i);
+        int stage = m_graph.AddTask("stage", StageTask, this, i);
+        m_graph.AddDependency(normals, parse);
+        m_graph.AddDependency(optimize, normals);
+        m_graph.AddDependency(stage, optimize);
+    }
+    m_graph.Start(maxThreads);
+}
+
+int SurfaceLoader::TakeFinished(ISurface** surface)
+{
+    int index = -1;
+    pthread_mutex_lock(&m_mutex);
+    if (!m_finished.empty()) {
+        index = m_finished.front();
+        m_finished.erase(m_finished.begin());
+    }
+    pthread_mutex_unlock(&m_mutex);
+    if (index == -1)
+        return -1;
+    
+    *surface = m_surfaces[index].Surface;
+    m_surfaces[index].Surface = 0;
+    ++m_taken;
+    return index;
+}
+
+void SurfaceLoader::ParseTask(void* context, int surfaceIndex)
+{
+    SurfaceLoader* loader = (SurfaceLoader*) context;
+    LoadingSurface& loading = loader->m_surfaces[surfaceIndex];
+    if (loader->m_cancelled || loading.Cancelled)
+        return;
+    
+    // Surfaces made in code are cached by what they tessellate to, so their
+    // levels of detail aren't simplified again on every load
+    if (loading.ObjPath.empty()) {
+        loading.SourceHash = HashSurface(*loading.Surface);
+        loading.CachePath = GetSurfaceCachePath(loading.SourceHash, loader->m_cacheDirectory);
+    } else {
+        loading.SourceHash = HashFile(loading.ObjPath);
+        loading.CachePath = GetMeshCachePath(loading.ObjPath, loader->m_cacheDirectory);
+    }
+    MeshCacheSurface * cached = new MeshCacheSurface(loading.CachePath, loading.SourceHash);
+    if (cached->IsValid()) {
+        delete loading.Surface;
+        loading.Surface = cached;
+        loading.Cached = true;
+        return;
+    }
+    delete cached;
+    if (!loading.Surface)
+        loading.Surface = new ObjSurface(loading.ObjPath);
+    loading.Empty = loading.Surface->GetVertexCount() == 0 || loading.Surface->GetTriangleIndexCount() == 0;
+}
+
+void SurfaceLoader::NormalsTask(void* context, int surfaceIndex)
+{
+    SurfaceLoader* loader = (SurfaceLoader*) context;
+    LoadingSurface& loading = loader->m_surfaces[surfaceIndex];
+    if (loader->m_cancelled || loading.Cancelled || loading.Cached || loading.Empty)
+        return;
+    loading.Surface = new StagedSurface(loading.Surface, false);
+}
+
+void SurfaceLoader::OptimizeTask(void* context, int surfaceIndex)
+{
+    SurfaceLoader* loader = (SurfaceLoader*) context;
+    LoadingSurface& loading = loader->m_surfaces[surfaceIndex];
+    if (loader->m_cancelled || loading.Cancelled || loading.Cached || loading.Empty)
+        return;
+    loading.Surface = new OptimizedSurface(loading.Surface);
+}
+
+void SurfaceLoader::StageTask(void* context, int surfaceIndex)
+{
+    SurfaceLoader* loader = (SurfaceLoader*) context;
+    LoadingSurface& loading = loader->m_surfaces[surfaceIndex];
+    if (loader->m_cancelled)
+        return;
+    if (!loading.Cached && !loading.Empty && !loading.Cancelled) {
+        loading.Surface = new StagedSurface(loading.Surface, true);
+        WriteMeshCache(*loading.Surface, loading.CachePath, loading.SourceHash);
+    }
+    
+    pthread_mutex_lock(&loader->m_mutex);
+    loader->m_finished.push_back(surfaceIndex);
+    pthread_mutex_unlock(&loader->m_mutex);
+}
@@ -0,0 +1,73 @@
+//
+//  SurfaceLoader.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_SurfaceLoader_h
+#define ModelViewer_SurfaceLoader_h
+
+#include "Interfaces.hpp"
+#include "TaskGraph.hpp"
+
+// Loads surfaces on background threads, so slow loads don't hold up the
+// thread that draws. Each surface goes through a chain of stages on a task
+// graph, while other surfaces go through theirs at the same time:
+//   parse     maps the surface's mesh cache if that is fresh, else reads
+//             its OBJ file; surfaces made in code are cached too, by what
+//             they tessellate to
+//   normals   generates the vertices, computing normals or tessellating
+//   optimize  reorders for the vertex caches and builds levels of detail
+//   stage     lays out the final vertex and index data (and writes the cache)
+// Surfaces from a fresh cache skip straight past the later stages, as do
+// surfaces with nothing to draw, e.g. from an empty or unreadable OBJ file,
+// which are handed over as parsed. Finished surfaces wait until the drawing
+// thread takes them, in the order they finish, and uploads them when it
+// suits it.
+class SurfaceLoader {
+public:
+    // OBJ files are loaded through the mesh cache in cacheDirectory.
+    SurfaceLoader(const string& cacheDirectory);
+    // Skips the stages not yet started, waits for the rest and deletes
+    // whatever was never taken.
+    ~SurfaceLoader();
+    // Queue surfaces to load, before Start; each returns the surface's index.
+    int AddObjFile(const string& path);
+    int AddSurface(ISurface * surface); // Takes ownership
+    // Starts loading on up to maxThreads threads (0 means one per core).
+    void Start(int maxThreads = 0);
+    // Skips the stages of the surface not yet started. It is still handed
+    // over, as far as it got, so may be anything from null to finished.
+    void Cancel(int surfaceIndex) { m_surfaces[surfaceIndex].Cancelled = true; }
+    // Hands over one finished surface and returns its index, or returns -1
+    // if none is waiting. The caller owns the surface.
+    int TakeFinished(ISurface** surface);
+    // Whether every surface has been loaded and taken.
+    bool IsDone() const { return m_taken == (int) m_surfaces.size(); }
+    // Timings of every stage, once IsDone.
+    const TaskGraph& GetTaskGraph() const { return m_graph; }
+private:
+    struct LoadingSurface {
+        string ObjPath; // Empty for surfaces given ready to tessellate
+        string CachePath;
+        unsigned long long SourceHash;
+        ISurface * Surface;
+        bool Cached; // From a fresh mesh cache, needing no further work
+        bool Empty; // No vertices or triangles, so nothing to stage or cache
+        volatile bool Cancelled;
+    };
+    SurfaceLoader(const SurfaceLoader&);
+    SurfaceLoader& operator=(const SurfaceLoader&);
+    static void ParseTask(void* loader, int surfaceIndex);
+    static void NormalsTask(void* loader, int surfaceIndex);
+    static void OptimizeTask(void* loader, int surfaceIndex);
+    static void StageTask(void* loader, int surfaceIndex);
+    string m_cacheDirectory;
+    vector<LoadingSurface> m_surfaces;
+    TaskGraph m_graph;
+    volatile bool m_cancelled;
+    int m_taken;
+    pthread_mutex_t m_mutex; // Guards m_finished
+    vector<int> m_finished; // Loaded but not yet taken, oldest first
+};
+
+#endif
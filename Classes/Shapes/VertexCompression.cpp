@@ -0,0 +1,141 @@
+//
+//  VertexCompression.cpp
+//  ModelViewer
+//
+
+#include "VertexCompression.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const float MaxQuantized = 32767;
+
+static float SignNotZero(float value)
+{
+    return value < 0 ? -1.0f : 1.0f;
+}
+
+static short ToShort(float value)
+{
+    return (short) std::max(-MaxQuantized, std::min(MaxQuantized, value));
+}
+
+// The point on the octahedron's unfolded square, in [-1, 1]^2.
+static vec2 EncodeOctahedral(vec3 normal)
+{
+    float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    vec2 encoded(normal.x / sum, normal.y / sum);
+    if (normal.z < 0) {
+        encoded = vec2((1 - std::fabs(encoded.y)) * SignNotZero(encoded.x),
+                       (1 - std::fabs(encoded.x)) * SignNotZero(encoded.y));
+    }
+    return encoded;
+}
+
+static vec3 DecodeOctahedral(float x, float y)
+{
+    vec3 normal(x, y, 1 - std::fabs(x) - std::fabs(y));
+    if (normal.z < 0) {
+        normal.x = (1 - std::fabs(y)) * SignNotZero(x);
+        normal.y = (1 - std::fabs(x)) * SignNotZero(y);
+    }
+    return normal.Normalized();
+}
+
+// Of the four roundings around the encoded point, the one decoding closest
+// to the normal; worth about a third of the error of plain rounding.
+static void QuantizeNormal(const vec3& normal, short* quantized)
+{
+    vec2 encoded = EncodeOctahedral(normal);
+    float x = std::floor(encoded.x * OctahedralScale);
+    float y = std::floor(encoded.y * OctahedralScale);
+    float bestDot = -2;
+    for (int i = 0; i < 4; ++i) {
+        float qx = x + (i & 1);
+        float qy = y + (i >> 1);
+        float dot = DecodeOctahedral(qx / OctahedralScale, qy / OctahedralScale).Dot(normal);
+        if (dot > bestDot) {
+            bestDot = dot;
+            quantized[0] = ToShort(qx);
+            quantized[1] = ToShort(qy);
+        }
+    }
+}
+
+mat4 VertexQuantization::ToMatrix() const
+{
+    return mat4::Scale(Scale.x, Scale.y, Scale.z) * mat4::Translate(Offset);
+}
+
+void CompressVertices(const float* vertices, int vertexCount, vector<CompactVertex>& compactVertices,
+                      VertexQuantization& quantization)
+{
+    compactVertices.resize(vertexCount);
+    if (vertexCount == 0) {
+        quantization.Offset = vec3(0, 0, 0);
+        quantization.Scale = vec3(1, 1, 1);
+        return;
+    }
+    
+    // Steps of half the box per MaxQuantized, about its center
+    float minimum[3], maximum[3];
+    for (int axis = 0; axis < 3; ++axis)
+        minimum[axis] = maximum[axis] = vertices[axis];
+    for (int i = 1; i < vertexCount; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            minimum[axis] = std::min(minimum[axis], vertices[i * 6 + axis]);
+            maximum[axis] = std::max(maximum[axis], vertices[i * 6 + axis]);
+        }
+    }
+    float offset[3], scale[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        float halfExtent = (maximum[axis] - minimum[axis]) / 2;
+        offset[axis] = (minimum[axis] + maximum[axis]) / 2;
+        scale[axis] = halfExtent > 0 ? halfExtent / MaxQuantized : 1;
+    }
+    quantization.Offset = vec3(offset[0], offset[1], offset[2]);
+    quantization.Scale = vec3(scale[0], scale[1], scale[2]);
+    
+    for (int i = 0; i < vertexCount; ++i) {
+        const float* vertex = vertices + i * 6;
+        CompactVertex& compact = compactVertices[i];
+        for (int axis = 0; axis < 3; ++axis)
+            compact.Position[axis] = ToShort(std::floor((vertex[axis] - offset[axis]) / scale[axis] + 0.5f));
+        compact.Position[3] = 1;
+        QuantizeNormal(vec3(vertex[3], vertex[4], vertex[5]), compact.Normal);
+    }
+}
+
+void DecompressVertex(const CompactVertex& vertex, const VertexQuantization& quantization,
+                      vec3& position, vec3& normal)
+{
+    const vec3& scale = quantization.Scale;
+    position = quantization.Offset + vec3(vertex.Position[0] * scale.x, vertex.Position[1] * scale.y,
+                                          vertex.Position[2] * scale.z);
+    normal = DecodeOctahedral(vertex.Normal[0] / OctahedralScale, vertex.Normal[1] / OctahedralScale);
+}
+
+CompressionError MeasureCompressionError(const float* vertices, const vector<CompactVertex>& compactVertices,
+                                         const VertexQuantization& quantization)
+{
+    CompressionError error = { 0, 0, 0, 0 };
+    if (compactVertices.empty())
+        return error;
+    
+    double normalErrorSum = 0;
+    for (size_t i = 0; i < compactVertices.size(); ++i) {
+        const float* vertex = vertices + i * 6;
+        vec3 position, normal;
+        DecompressVertex(compactVertices[i], quantization, position, normal);
+        float positionError = (position - vec3(vertex[0], vertex[1], vertex[2])).Length();
+        float dot = std::max(-1.0f, std::min(1.0f, normal.Dot(vec3(vertex[3], vertex[4], vertex[5]).Normalized())));
+        float normalError = std::acos(dot) * 180 / Pi;
+        error.MaxPositionError = std::max(error.MaxPositionError, positionError);
+        error.MaxNormalErrorDegrees = std::max(error.MaxNormalErrorDegrees, normalError);
+        normalErrorSum += normalError;
+    }
+    vec3 halfExtent(quantization.Scale.x * MaxQuantized, quantization.Scale.y * MaxQuantized,
+                    quantization.Scale.z * MaxQuantized);
+    error.MaxRelativePositionError = error.MaxPositionError / (halfExtent * 2).Length();
+    error.MeanNormalErrorDegrees = normalErrorSum / compactVertices.size();
+    return error;
+}
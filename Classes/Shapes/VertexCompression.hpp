@@ -0,0 +1,49 @@
+//
+//  VertexCompression.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_VertexCompression_h
+#define ModelViewer_VertexCompression_h
+
+#include "Interfaces.hpp"
+#include "Matrix.hpp"
+
+// A 12 byte vertex: the position in 16-bit steps across the surface's
+// bounding box, w fixed at 1, and the normal octahedral-encoded in two
+// 16-bit components. Read as unnormalized shorts, so no GL version's
+// normalization rule matters; VertexQuantization turns the position back
+// into surface units, and the shader divides the normal by OctahedralScale.
+struct CompactVertex {
+    short Position[4];
+    short Normal[2];
+};
+
+const float OctahedralScale = 32767;
+
+// Maps quantized positions back: position = Offset + quantized * Scale.
+struct VertexQuantization {
+    vec3 Offset;
+    vec3 Scale;
+    // As a transform to apply before the modelview matrix.
+    mat4 ToMatrix() const;
+};
+
+// How far the compact vertices are from the float ones they came from.
+struct CompressionError {
+    float MaxPositionError; // In surface units
+    float MaxRelativePositionError; // Over the bounding box diagonal
+    float MeanNormalErrorDegrees;
+    float MaxNormalErrorDegrees;
+};
+
+// Compresses vertexCount vertices laid out as GenerateVertices(VertexFlagsNormal)
+// makes them, quantizing against their own bounding box.
+void CompressVertices(const float* vertices, int vertexCount, vector<CompactVertex>& compactVertices,
+                      VertexQuantization& quantization);
+void DecompressVertex(const CompactVertex& vertex, const VertexQuantization& quantization,
+                      vec3& position, vec3& normal);
+CompressionError MeasureCompressionError(const float* vertices, const vector<CompactVertex>& compactVertices,
+                                         const VertexQuantization& quantization);
+
+#endif
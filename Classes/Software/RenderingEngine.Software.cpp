@@ -0,0 +1,316 @@
+//
+//  RenderingEngine.Software.cpp
+//  ModelViewer
+//
+
+#include "RenderingEngine.Software.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace Software {
+
+static const int TileSize = 64;
+static const int VertexBlockSize = 4096;
+static const int TriangleBlockSize = 2048;
+
+// Material and light of the ES2 backend
+static const vec3 ClearColor(0.0f, 0.125f, 0.25f);
+static const vec3 AmbientMaterial(0.04f, 0.04f, 0.04f);
+static const vec3 SpecularMaterial(0.5f, 0.5f, 0.5f);
+static const float Shininess = 50;
+static const vec3 LightPosition(0.25f, 0.25f, 1);
+
+IRenderingEngine * CreateRenderingEngine(int width, int height) {
+    return new RenderingEngine(width, height);
+}
+
+static unsigned char ToColorByte(float value) {
+    return (unsigned char) (min(max(value, 0.0f), 1.0f) * 255 + 0.5f);
+}
+
+RenderingEngine::RenderingEngine(int width, int height, int maxThreads) :
+m_width(width),
+m_height(height),
+m_tileCount((width + TileSize - 1) / TileSize, (height + TileSize - 1) / TileSize),
+m_pool(maxThreads),
+m_visuals(0),
+m_colorBuffer(width * height * 4),
+m_depthBuffer(width * height, 1.0f)
+{
+}
+
+static void CreateMesh(const ISurface& surface, Mesh& mesh) {
+    const float* vertexData = surface.GetVertexData();
+    if (vertexData)
+        mesh.Vertices.assign(vertexData, vertexData + surface.GetVertexCount() * 6);
+    else
+        surface.GenerateVertices(mesh.Vertices, VertexFlagsNormal);
+    GenerateLodTriangleIndices(surface, mesh.Indices);
+    GetLodRanges(surface, mesh.Lods);
+}
+
+void RenderingEngine::Initialize(const vector<ISurface *> &surfaces) {
+    m_meshes.resize(surfaces.size());
+    for (size_t i = 0; i < surfaces.size(); ++i)
+        CreateMesh(*surfaces[i], m_meshes[i]);
+    m_translation = mat4::Translate(0, 0, -7);
+}
+
+void RenderingEngine::SetSurface(int surfaceIndex, const ISurface& surface) {
+    if (surfaceIndex >= (int) m_meshes.size())
+        m_meshes.resize(surfaceIndex + 1);
+    Mesh mesh;
+    CreateMesh(surface, mesh);
+    m_meshes[surfaceIndex].Vertices.swap(mesh.Vertices);
+    m_meshes[surfaceIndex].Indices.swap(mesh.Indices);
+    m_meshes[surfaceIndex].Lods.swap(mesh.Lods);
+}
+
+void RenderingEngine::ReleaseSurface(int surfaceIndex) {
+    Mesh empty;
+    m_meshes[surfaceIndex].Vertices.swap(empty.Vertices);
+    m_meshes[surfaceIndex].Indices.swap(empty.Indices);
+    m_meshes[surfaceIndex].Lods.swap(empty.Lods);
+}
+
+size_t RenderingEngine::GetSurfaceBytes(int surfaceIndex) const {
+    if (surfaceIndex >= (int) m_meshes.size())
+        return 0;
+    const Mesh& mesh = m_meshes[surfaceIndex];
+    return mesh.Vertices.size() * sizeof(float) + mesh.Indices.size() * sizeof(unsigned int);
+}
+
+void RenderingEngine::Render(const VisualList& visuals) const {
+    m_visuals = visuals.Visuals;
+    int visualCount = visuals.Count;
+    m_transforms.resize(visualCount);
+    m_normalMatrices.resize(visualCount);
+    m_lods.resize(visualCount);
+    m_vertexOffsets.resize(visualCount);
+    m_triangleOffsets.resize(visualCount);
+    m_vertexRanges.clear();
+    m_triangleRanges.clear();
+    
+    int vertexCount = 0;
+    int triangleCount = 0;
+    for (int visualIndex = 0; visualIndex < visualCount; ++visualIndex) {
+        const Visual& visual = visuals[visualIndex];
+        const Mesh& mesh = m_meshes[visual.Surface];
+    
+        // Same transforms as the OpenGL backends
+        ivec2 size = visual.ViewportSize;
+        mat4 rotation(visual.Orientation.ToMatrix());
+        mat4 modelview = rotation * mat4::Translate(visual.Position) * m_translation;
+        float h = 4.0 * size.y / size.x;
+        mat4 projection = mat4::Frustum(-2, 2, -h / 2, h / 2, 5, 10);
+        m_transforms[visualIndex] = modelview * projection;
+        m_normalMatrices[visualIndex] = modelview.ToMat3();
+        m_lods[visualIndex] = mesh.Lods[ChooseLod(mesh.Lods, size)];
+    
+        int meshVertexCount = mesh.Vertices.size() / 6;
+        m_vertexOffsets[visualIndex] = vertexCount;
+        for (int first = 0; first < meshVertexCount; first += VertexBlockSize) {
+            WorkRange range = { visualIndex, first, min(VertexBlockSize, meshVertexCount - first) };
+            m_vertexRanges.push_back(range);
+        }
+        vertexCount += meshVertexCount;
+    
+        int meshTriangleCount = m_lods[visualIndex].IndexCount / 3;
+        m_triangleOffsets[visualIndex] = triangleCount;
+        for (int first = 0; first < meshTriangleCount; first += TriangleBlockSize) {
+            WorkRange range = { visualIndex, first, min(TriangleBlockSize, meshTriangleCount - first) };
+            m_triangleRanges.push_back(range);
+        }
+        triangleCount += meshTriangleCount;
+    }
+    m_screenVertices.resize(vertexCount);
+    m_triangles.resize(triangleCount);
+    m_bins.resize(max(m_bins.size(), m_triangleRanges.size() * m_tileCount.x * m_tileCount.y));
+    
+    m_pool.Run(m_vertexRanges.size(), TransformTask, (void*) this);
+    m_pool.Run(m_triangleRanges.size(), SetupTask, (void*) this);
+    m_pool.Run(m_tileCount.x * m_tileCount.y, RasterizeTask, (void*) this);
+}
+
+void RenderingEngine::TransformTask(void* context, int index) {
+    const RenderingEngine* engine = (const RenderingEngine*) context;
+    engine->Transform(engine->m_vertexRanges[index]);
+}
+
+void RenderingEngine::SetupTask(void* context, int index) {
+    ((const RenderingEngine*) context)->Setup(index);
+}
+
+void RenderingEngine::RasterizeTask(void* context, int index) {
+    ((const RenderingEngine*) context)->Rasterize(index);
+}
+
+void RenderingEngine::Transform(const WorkRange& range) const {
+    const Visual& visual = m_visuals[range.Visual];
+    const float* vertex = &m_meshes[m_visuals[range.Visual].Surface].Vertices[range.First * 6];
+    ScreenVertex* out = &m_screenVertices[m_vertexOffsets[range.Visual] + range.First];
+    const mat4& m = m_transforms[range.Visual];
+    const mat3& n = m_normalMatrices[range.Visual];
+    vec2 scale(visual.ViewportSize.x * 0.5f, visual.ViewportSize.y * 0.5f);
+    vec2 origin(visual.LowerLeft.x + scale.x, visual.LowerLeft.y + scale.y);
+    
+    for (int i = 0; i < range.Count; ++i, vertex += 6, ++out) {
+        // Vectors multiply matrices from the left, as the uploaded GL matrices expect
+        float x = vertex[0], y = vertex[1], z = vertex[2];
+        float clipX = x * m.x.x + y * m.y.x + z * m.z.x + m.w.x;
+        float clipY = x * m.x.y + y * m.y.y + z * m.z.y + m.w.y;
+        float clipZ = x * m.x.z + y * m.y.z + z * m.z.z + m.w.z;
+        float clipW = x * m.x.w + y * m.y.w + z * m.z.w + m.w.w;
+        float inverseW = clipW > 0 ? 1 / clipW : 0;
+        out->X = origin.x + clipX * inverseW * scale.x;
+        out->Y = origin.y + clipY * inverseW * scale.y;
+        out->Depth = (clipZ * inverseW + 1) * 0.5f;
+        out->InverseW = inverseW;
+    
+        float nx = vertex[3], ny = vertex[4], nz = vertex[5];
+        out->Normal.x = nx * n.x.x + ny * n.y.x + nz * n.z.x;
+        out->Normal.y = nx * n.x.y + ny * n.y.y + nz * n.z.y;
+        out->Normal.z = nx * n.x.z + ny * n.y.z + nz * n.z.z;
+    }
+}
+
+void RenderingEngine::Setup(int rangeIndex) const {
+    const WorkRange& range = m_triangleRanges[rangeIndex];
+    int tileCount = m_tileCount.x * m_tileCount.y;
+    vector<int>* bins = &m_bins[rangeIndex * tileCount];
+    for (int tile = 0; tile < tileCount; ++tile)
+        bins[tile].clear();
+    
+    const Visual& visual = m_visuals[range.Visual];
+    const Mesh& mesh = m_meshes[visual.Surface];
+    const unsigned int* index = &mesh.Indices[m_lods[range.Visual].FirstIndex + range.First * 3];
+    const ScreenVertex* vertices = &m_screenVertices[m_vertexOffsets[range.Visual]];
+    int firstTriangle = m_triangleOffsets[range.Visual] + range.First;
+    ivec2 viewportMin(max(visual.LowerLeft.x, 0), max(visual.LowerLeft.y, 0));
+    ivec2 viewportMax(min(visual.LowerLeft.x + visual.ViewportSize.x, m_width) - 1,
+                      min(visual.LowerLeft.y + visual.ViewportSize.y, m_height) - 1);
+    vec3 diffuse = visual.Color * 0.75;
+    
+    for (int t = 0; t < range.Count; ++t, index += 3) {
+        const ScreenVertex* p[3] = { &vertices[index[0]], &vertices[index[1]], &vertices[index[2]] };
+    
+        // Triangles reaching behind the eye are dropped rather than clipped;
+        // the near and far planes are applied per pixel instead
+        if (p[0]->InverseW == 0 || p[1]->InverseW == 0 || p[2]->InverseW == 0)
+            continue;
+    
+        // Both windings are drawn, as the OpenGL backends don't cull; make it counter-clockwise
+        float area = (p[1]->X - p[0]->X) * (p[2]->Y - p[0]->Y) - (p[1]->Y - p[0]->Y) * (p[2]->X - p[0]->X);
+        if (area == 0)
+            continue;
+        if (area < 0) {
+            swap(p[1], p[2]);
+            area = -area;
+        }
+    
+        // Pixels whose centers fall in the bounding box, within the viewport
+        float minX = min(p[0]->X, min(p[1]->X, p[2]->X));
+        float maxX = max(p[0]->X, max(p[1]->X, p[2]->X));
+        float minY = min(p[0]->Y, min(p[1]->Y, p[2]->Y));
+        float maxY = max(p[0]->Y, max(p[1]->Y, p[2]->Y));
+        ivec2 pixelMin(max(viewportMin.x, (int) ceil(minX - 0.5f)), max(viewportMin.y, (int) ceil(minY - 0.5f)));
+        ivec2 pixelMax(min(viewportMax.x, (int) floor(maxX - 0.5f)), min(viewportMax.y, (int) floor(maxY - 0.5f)));
+        if (pixelMin.x > pixelMax.x || pixelMin.y > pixelMax.y)
+            continue;
+    
+        TriangleSetup& triangle = m_triangles[firstTriangle + t];
+        triangle.Min = pixelMin;
+        triangle.Max = pixelMax;
+        for (int i = 0; i < 3; ++i) {
+            // Edge opposite vertex i; positive inside, and equal to 1 at vertex i
+            const ScreenVertex& from = *p[(i + 1) % 3];
+            const ScreenVertex& to = *p[(i + 2) % 3];
+            float dx = to.X - from.X;
+            float dy = to.Y - from.Y;
+            triangle.Edges[i][0] = -dy / area;
+            triangle.Edges[i][1] = dx / area;
+            triangle.Edges[i][2] = (dy * from.X - dx * from.Y) / area;
+            triangle.TopLeft[i] = dy < 0 || (dy == 0 && dx > 0);
+            triangle.Depth[i] = p[i]->Depth;
+            triangle.InverseW[i] = p[i]->InverseW;
+            triangle.Normal[i] = p[i]->Normal * p[i]->InverseW;
+        }
+        triangle.Diffuse = diffuse;
+    
+        for (int tileY = pixelMin.y / TileSize; tileY <= pixelMax.y / TileSize; ++tileY)
+            for (int tileX = pixelMin.x / TileSize; tileX <= pixelMax.x / TileSize; ++tileX)
+                bins[tileY * m_tileCount.x + tileX].push_back(firstTriangle + t);
+    }
+}
+
+void RenderingEngine::Rasterize(int tile) const {
+    ivec2 tileMin((tile % m_tileCount.x) * TileSize, (tile / m_tileCount.x) * TileSize);
+    ivec2 tileMax(min(tileMin.x + TileSize, m_width) - 1, min(tileMin.y + TileSize, m_height) - 1);
+    
+    unsigned char clear[4] = { ToColorByte(ClearColor.x), ToColorByte(ClearColor.y), ToColorByte(ClearColor.z), 255 };
+    for (int y = tileMin.y; y <= tileMax.y; ++y) {
+        unsigned char* color = &m_colorBuffer[(y * m_width + tileMin.x) * 4];
+        for (int x = tileMin.x; x <= tileMax.x; ++x, color += 4)
+            copy(clear, clear + 4, color);
+        fill(&m_depthBuffer[y * m_width + tileMin.x], &m_depthBuffer[y * m_width + tileMax.x] + 1, 1.0f);
+    }
+    
+    // Bins are walked in range order, so triangles land in draw order whichever thread binned them
+    int tileCount = m_tileCount.x * m_tileCount.y;
+    for (size_t range = 0; range < m_triangleRanges.size(); ++range) {
+        const vector<int>& bin = m_bins[range * tileCount + tile];
+        for (size_t i = 0; i < bin.size(); ++i)
+            ShadeTriangle(m_triangles[bin[i]], tileMin, tileMax);
+    }
+}
+
+void RenderingEngine::ShadeTriangle(const TriangleSetup& triangle, ivec2 tileMin, ivec2 tileMax) const {
+    ivec2 pixelMin(max(triangle.Min.x, tileMin.x), max(triangle.Min.y, tileMin.y));
+    ivec2 pixelMax(min(triangle.Max.x, tileMax.x), min(triangle.Max.y, tileMax.y));
+    const float (*edge)[3] = triangle.Edges;
+    vec3 L = LightPosition.Normalized();
+    vec3 E(0, 0, 1);
+    vec3 H = (L + E).Normalized();
+    
+    for (int y = pixelMin.y; y <= pixelMax.y; ++y) {
+        float centerX = pixelMin.x + 0.5f;
+        float centerY = y + 0.5f;
+        float w0 = edge[0][0] * centerX + edge[0][1] * centerY + edge[0][2];
+        float w1 = edge[1][0] * centerX + edge[1][1] * centerY + edge[1][2];
+        float w2 = edge[2][0] * centerX + edge[2][1] * centerY + edge[2][2];
+        int pixel = y * m_width + pixelMin.x;
+        for (int x = pixelMin.x; x <= pixelMax.x; ++x, ++pixel, w0 += edge[0][0], w1 += edge[1][0], w2 += edge[2][0]) {
+            bool inside = (w0 > 0 || (w0 == 0 && triangle.TopLeft[0])) &&
+                          (w1 > 0 || (w1 == 0 && triangle.TopLeft[1])) &&
+                          (w2 > 0 || (w2 == 0 && triangle.TopLeft[2]));
+            if (!inside)
+                continue;
+    
+            // Depth is linear in screen space; GL_LESS against the buffer
+            float depth = w0 * triangle.Depth[0] + w1 * triangle.Depth[1] + w2 * triangle.Depth[2];
+            if (depth < 0 || depth > 1 || depth >= m_depthBuffer[pixel])
+                continue;
+            m_depthBuffer[pixel] = depth;
+    
+            // The normals were divided by w, so this is perspective correct up to a
+            // positive scale, which normalizing removes
+            vec3 N = triangle.Normal[0] * w0 + triangle.Normal[1] * w1 + triangle.Normal[2] * w2;
+            N.Normalize();
+    
+            // PixelLighting.frag
+            float df = max(0.0f, N.Dot(L));
+            float sf = max(0.0f, N.Dot(H));
+            sf = pow(sf, Shininess);
+            vec3 color = AmbientMaterial + triangle.Diffuse * df + SpecularMaterial * sf;
+            unsigned char* out = &m_colorBuffer[pixel * 4];
+            out[0] = ToColorByte(color.x);
+            out[1] = ToColorByte(color.y);
+            out[2] = ToColorByte(color.z);
+            out[3] = 255;
+        }
+    }
+}
+
+}
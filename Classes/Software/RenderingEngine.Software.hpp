@@ -0,0 +1,105 @@
+//
+//  RenderingEngine.Software.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_RenderingEngine_Software_h
+#define ModelViewer_RenderingEngine_Software_h
+
+#include "Interfaces.hpp"
+#include "Matrix.hpp"
+#include "MeshSimplifier.hpp"
+#include "ThreadPool.hpp"
+
+namespace Software {
+
+struct Mesh {
+    vector<float> Vertices; // Position and normal, as GenerateVertices(VertexFlagsNormal) produces them
+    vector<unsigned int> Indices; // Every level of detail, back to back
+    vector<LodRange> Lods;
+};
+
+// A vertex after the modelview, projection and viewport transforms.
+struct ScreenVertex {
+    float X;
+    float Y;
+    float Depth;
+    float InverseW; // 0 when the vertex is behind the eye
+    vec3 Normal; // In eye space
+};
+
+// Everything the rasterizer needs to fill a triangle, with the attributes
+// as planes over the screen so any pixel can be interpolated directly.
+struct TriangleSetup {
+    ivec2 Min; // Inclusive pixel bounds, already clipped to the viewport
+    ivec2 Max;
+    float Edges[3][3]; // a * x + b * y + c for each edge, scaled to give barycentric weights
+    bool TopLeft[3]; // Whether pixels exactly on the edge belong to the triangle
+    float Depth[3];
+    float InverseW[3];
+    vec3 Normal[3]; // Divided by w, for perspective correct interpolation
+    vec3 Diffuse;
+};
+
+// Part of a surface handed to one thread: a vertex or triangle range of one visual.
+struct WorkRange {
+    int Visual;
+    int First;
+    int Count;
+};
+
+// Renders on the CPU into an in-memory color and depth buffer, so models can
+// be drawn without an EAGL context, e.g. on a render farm or in tests.
+// The screen is split into tiles; triangles are set up and binned to the
+// tiles they touch, then tiles are rasterized independently on all cores.
+// The three phases run on a pool of threads kept for the engine's lifetime.
+// Shading follows the Blinn-Phong model of PixelLighting.frag per pixel.
+class RenderingEngine : public IRenderingEngine {
+public:
+    RenderingEngine(int width, int height, int maxThreads = 0);
+    void Initialize(const vector<ISurface*>& surfaces);
+    void Render(const VisualList& visuals) const;
+    void SetSurface(int surfaceIndex, const ISurface& surface);
+    void ReleaseSurface(int surfaceIndex);
+    // Of the meshes in memory, there being no GPU buffers.
+    size_t GetSurfaceBytes(int surfaceIndex) const;
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    // RGBA, 8 bits per channel, bottom row first like glReadPixels.
+    const unsigned char* GetColorBuffer() const { return &m_colorBuffer[0]; }
+    // Window-space depth in [0, 1].
+    const float* GetDepthBuffer() const { return &m_depthBuffer[0]; }
+private:
+    static void TransformTask(void* context, int index);
+    static void SetupTask(void* context, int index);
+    static void RasterizeTask(void* context, int index);
+    void Transform(const WorkRange& range) const;
+    void Setup(int rangeIndex) const;
+    void Rasterize(int tile) const;
+    void ShadeTriangle(const TriangleSetup& triangle, ivec2 tileMin, ivec2 tileMax) const;
+    int m_width;
+    int m_height;
+    ivec2 m_tileCount;
+    vector<Mesh> m_meshes;
+    mat4 m_translation;
+
+    // Per-frame state, kept between frames so its memory is reused
+    mutable ThreadPool m_pool;
+    mutable const Visual* m_visuals;
+    mutable vector<mat4> m_transforms; // Modelview-projection of each visual
+    mutable vector<mat3> m_normalMatrices;
+    mutable vector<LodRange> m_lods; // The level of detail each visual draws
+    mutable vector<int> m_vertexOffsets; // Where each visual's vertices start in m_screenVertices
+    mutable vector<int> m_triangleOffsets; // Where each visual's triangles start in m_triangles
+    mutable vector<ScreenVertex> m_screenVertices;
+    mutable vector<TriangleSetup> m_triangles;
+    mutable vector<WorkRange> m_vertexRanges;
+    mutable vector<WorkRange> m_triangleRanges;
+    mutable vector< vector<int> > m_bins; // Triangles per triangle range and tile, in draw order
+    mutable vector<unsigned char> m_colorBuffer;
+    mutable vector<float> m_depthBuffer;
+};
+
+}
+
+#endif
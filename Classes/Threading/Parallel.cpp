@@ -0,0 +1,54 @@
+//
+//  Parallel.cpp
+//  ModelViewer
+//
+
+#include "Parallel.hpp"
+#include <pthread.h>
+#include <unistd.h>
+
+// More threads than this are never started, so their handles fit on the
+// stack and a ParallelFor doesn't allocate.
+static const int MaxThreadCount = 64;
+
+struct ParallelWork {
+    ParallelTask Task;
+    void* Context;
+    int Count;
+    volatile int Next;
+};
+
+static void* RunParallelWork(void* argument)
+{
+    ParallelWork* work = (ParallelWork*) argument;
+    int index;
+    while ((index = __sync_fetch_and_add(&work->Next, 1)) < work->Count)
+        work->Task(work->Context, index);
+    return 0;
+}
+
+int GetCoreCount()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int) cores : 1;
+}
+
+void ParallelFor(int count, ParallelTask task, void* context, int maxThreads)
+{
+    int threadCount = maxThreads > 0 ? maxThreads : GetCoreCount();
+    if (threadCount > count)
+        threadCount = count;
+    if (threadCount > MaxThreadCount)
+        threadCount = MaxThreadCount;
+    
+    ParallelWork work = { task, context, count, 0 };
+    pthread_t threads[MaxThreadCount];
+    int startedCount = 0;
+    for (int i = 1; i < threadCount; ++i) {
+        if (pthread_create(&threads[startedCount], 0, RunParallelWork, &work) == 0)
+            ++startedCount;
+    }
+    RunParallelWork(&work);
+    for (int i = 0; i < startedCount; ++i)
+        pthread_join(threads[i], 0);
+}
@@ -0,0 +1,31 @@
+//
+//  Parallel.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_Parallel_h
+#define ModelViewer_Parallel_h
+
+typedef void (*ParallelTask)(void* context, int index);
+
+// Number of cores available to the process (at least 1).
+int GetCoreCount();
+
+// Calls task(context, i) for every i in [0, count), spreading the indices
+// over up to maxThreads threads (0 means one per core). The calling thread
+// takes part in the work and the call returns once every index is done.
+void ParallelFor(int count, ParallelTask task, void* context, int maxThreads = 0);
+
+template <typename Task>
+void InvokeParallelTask(void* context, int index)
+{
+    (*(Task*) context)(index);
+}
+
+template <typename Task>
+void ParallelFor(int count, Task& task, int maxThreads = 0)
+{
+    ParallelFor(count, &InvokeParallelTask<Task>, &task, maxThreads);
+}
+
+#endif
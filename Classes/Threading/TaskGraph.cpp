@@ -0,0 +1,245 @@
+//
+//  TaskGraph.cpp
+//  ModelViewer
+//
+
+#include "TaskGraph.hpp"
+#include <sys/time.h>
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+static double GetSeconds()
+{
+    timeval time;
+    gettimeofday(&time, 0);
+    return time.tv_sec + time.tv_usec * 1e-6;
+}
+
+TaskGraph::TaskGraph() :
+m_ready(0),
+m_remaining(0),
+m_started(false),
+m_startTime(0)
+{
+    pthread_mutex_init(&m_mutex, 0);
+    pthread_cond_init(&m_condition, 0);
+}
+
+TaskGraph::~TaskGraph()
+{
+    Wait();
+    for (size_t i = 0; i < m_queues.size(); ++i) {
+        pthread_mutex_destroy(&m_queues[i]->Mutex);
+        delete m_queues[i];
+    }
+    pthread_cond_destroy(&m_condition);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+int TaskGraph::AddTask(const char* stage, ParallelTask function, void* context, int index)
+{
+    assert(!m_started && "Tasks must be added before the graph starts.");
+    Task task;
+    task.Function = function;
+    task.Context = context;
+    task.Pending = 0;
+    task.Timing.Stage = stage;
+    task.Timing.Index = index;
+    task.Timing.Start = 0;
+    task.Timing.End = 0;
+    m_tasks.push_back(task);
+    return m_tasks.size() - 1;
+}
+
+void TaskGraph::AddDependency(int task, int dependency)
+{
+    assert(!m_started && "Dependencies must be added before the graph starts.");
+    m_tasks[dependency].Successors.push_back(task);
+    m_tasks[task].Dependencies.push_back(dependency);
+    ++m_tasks[task].Pending;
+}
+
+void TaskGraph::Start(int maxThreads)
+{
+    assert(!m_started && "The graph runs once.");
+    m_started = true;
+    m_startTime = GetSeconds();
+    m_remaining = m_tasks.size();
+    if (m_tasks.empty())
+        return;
+    
+    int threadCount = std::min((int) m_tasks.size(), maxThreads > 0 ? maxThreads : GetCoreCount());
+    m_queues.resize(threadCount);
+    m_workers.resize(threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        m_queues[i] = new WorkerQueue();
+        pthread_mutex_init(&m_queues[i]->Mutex, 0);
+        m_workers[i].Graph = this;
+        m_workers[i].Index = i;
+    }
+    
+    // Deal the tasks that are ready from the start out to the workers in turn
+    int worker = 0;
+    for (size_t task = 0; task < m_tasks.size(); ++task) {
+        if (m_tasks[task].Pending == 0) {
+            Push(worker, task);
+            worker = (worker + 1) % threadCount;
+        }
+    }
+    
+    for (int i = 0; i < threadCount; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, RunWorker, &m_workers[i]) == 0)
+            m_threads.push_back(thread);
+    }
+    
+    // Without any thread, run everything up front rather than never
+    if (m_threads.empty())
+        RunWorker(&m_workers[0]);
+}
+
+void TaskGraph::Wait()
+{
+    if (!m_started)
+        return;
+    pthread_mutex_lock(&m_mutex);
+    while (m_remaining > 0)
+        pthread_cond_wait(&m_condition, &m_mutex);
+    pthread_mutex_unlock(&m_mutex);
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        pthread_join(m_threads[i], 0);
+    m_threads.clear();
+}
+
+void* TaskGraph::RunWorker(void* argument)
+{
+    Worker* worker = (Worker*) argument;
+    TaskGraph* graph = worker->Graph;
+    for (;;) {
+        int task = graph->PopOrSteal(worker->Index);
+        if (task != -1) {
+            graph->Run(worker->Index, task);
+            continue;
+        }
+    
+        // Sleep until some task becomes ready or the last one finishes
+        pthread_mutex_lock(&graph->m_mutex);
+        while (graph->m_ready == 0 && graph->m_remaining > 0)
+            pthread_cond_wait(&graph->m_condition, &graph->m_mutex);
+        bool done = graph->m_remaining == 0;
+        pthread_mutex_unlock(&graph->m_mutex);
+        if (done)
+            return 0;
+    }
+}
+
+void TaskGraph::Push(int worker, int task)
+{
+    WorkerQueue* queue = m_queues[worker];
+    pthread_mutex_lock(&queue->Mutex);
+    queue->Tasks.push_back(task);
+    pthread_mutex_unlock(&queue->Mutex);
+    
+    pthread_mutex_lock(&m_mutex);
+    ++m_ready;
+    pthread_cond_broadcast(&m_condition);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+int TaskGraph::PopOrSteal(int worker)
+{
+    // The newest task of our own queue, else the oldest of someone else's
+    int task = -1;
+    int queueCount = m_queues.size();
+    for (int i = 0; i < queueCount && task == -1; ++i) {
+        WorkerQueue* queue = m_queues[(worker + i) % queueCount];
+        pthread_mutex_lock(&queue->Mutex);
+        if (!queue->Tasks.empty()) {
+            if (i == 0) {
+                task = queue->Tasks.back();
+                queue->Tasks.pop_back();
+            } else {
+                task = queue->Tasks.front();
+                queue->Tasks.pop_front();
+            }
+        }
+        pthread_mutex_unlock(&queue->Mutex);
+    }
+    
+    if (task != -1) {
+        pthread_mutex_lock(&m_mutex);
+        --m_ready;
+        pthread_mutex_unlock(&m_mutex);
+    }
+    return task;
+}
+
+void TaskGraph::Run(int worker, int taskIndex)
+{
+    Task& task = m_tasks[taskIndex];
+    task.Timing.Start = GetElapsedSeconds();
+    task.Function(task.Context, task.Timing.Index);
+    task.Timing.End = GetElapsedSeconds();
+    
+    for (size_t i = 0; i < task.Successors.size(); ++i) {
+        int successor = task.Successors[i];
+        if (__sync_sub_and_fetch(&m_tasks[successor].Pending, 1) == 0)
+            Push(worker, successor);
+    }
+    
+    pthread_mutex_lock(&m_mutex);
+    if (--m_remaining == 0)
+        pthread_cond_broadcast(&m_condition);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+double TaskGraph::GetElapsedSeconds() const
+{
+    return GetSeconds() - m_startTime;
+}
+
+void TaskGraph::GetStageTimings(std::vector<StageTiming>& stages) const
+{
+    stages.clear();
+    for (size_t task = 0; task < m_tasks.size(); ++task) {
+        const TaskTiming& timing = m_tasks[task].Timing;
+        size_t stage = 0;
+        while (stage < stages.size() && strcmp(stages[stage].Stage, timing.Stage) != 0)
+            ++stage;
+        if (stage == stages.size()) {
+            StageTiming empty = { timing.Stage, 0, 0, 0 };
+            stages.push_back(empty);
+        }
+        double seconds = timing.End - timing.Start;
+        stages[stage].TaskCount++;
+        stages[stage].TotalSeconds += seconds;
+        stages[stage].MaxSeconds = std::max(stages[stage].MaxSeconds, seconds);
+    }
+}
+
+void TaskGraph::GetCriticalPath(std::vector<int>& tasks) const
+{
+    tasks.clear();
+    if (m_tasks.empty())
+        return;
+    
+    int task = 0;
+    for (size_t i = 1; i < m_tasks.size(); ++i) {
+        if (m_tasks[i].Timing.End > m_tasks[task].Timing.End)
+            task = i;
+    }
+    for (;;) {
+        tasks.push_back(task);
+        const std::vector<int>& dependencies = m_tasks[task].Dependencies;
+        if (dependencies.empty())
+            break;
+        int latest = dependencies[0];
+        for (size_t i = 1; i < dependencies.size(); ++i) {
+            if (m_tasks[dependencies[i]].Timing.End > m_tasks[latest].Timing.End)
+                latest = dependencies[i];
+        }
+        task = latest;
+    }
+    std::reverse(tasks.begin(), tasks.end());
+}
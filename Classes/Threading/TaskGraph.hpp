@@ -0,0 +1,93 @@
+//
+//  TaskGraph.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_TaskGraph_h
+#define ModelViewer_TaskGraph_h
+
+#include "Parallel.hpp"
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+// When a task of the graph ran, in seconds since the graph started.
+struct TaskTiming {
+    const char* Stage;
+    int Index; // As passed to the task
+    double Start;
+    double End;
+};
+
+// Totals over every task of one stage.
+struct StageTiming {
+    const char* Stage;
+    int TaskCount;
+    double TotalSeconds;
+    double MaxSeconds;
+};
+
+// A set of tasks with dependencies between them, run on a small pool of
+// worker threads. Each worker keeps its own queue of ready tasks and pushes
+// the tasks its work unblocks onto it, so a chain of stages tends to stay on
+// one thread; idle workers steal the oldest task from another's queue.
+// Tasks are added and linked before Start, and every task records when it
+// ran, labelled with its stage, so the critical path can be found afterwards.
+class TaskGraph {
+public:
+    TaskGraph();
+    // Waits for the tasks to finish if the graph was started.
+    ~TaskGraph();
+    // Adds task(context, index) and returns its id. stage must outlive the graph.
+    int AddTask(const char* stage, ParallelTask task, void* context, int index);
+    // Makes task wait until dependency has finished.
+    void AddDependency(int task, int dependency);
+    // Starts running the tasks on up to maxThreads workers (0 means one per
+    // core) and returns at once.
+    void Start(int maxThreads = 0);
+    // Blocks until every task has finished.
+    void Wait();
+    bool IsDone() const { return m_remaining == 0; }
+    // Only meaningful for finished tasks.
+    const TaskTiming& GetTaskTiming(int task) const { return m_tasks[task].Timing; }
+    void GetStageTimings(std::vector<StageTiming>& stages) const;
+    // The chain of tasks, first to last, that ended with the last task to
+    // finish, each following the dependency that finished latest.
+    void GetCriticalPath(std::vector<int>& tasks) const;
+private:
+    struct Task {
+        ParallelTask Function;
+        void* Context;
+        volatile int Pending; // Unfinished dependencies
+        std::vector<int> Successors;
+        std::vector<int> Dependencies;
+        TaskTiming Timing;
+    };
+    struct WorkerQueue {
+        pthread_mutex_t Mutex;
+        std::deque<int> Tasks;
+    };
+    struct Worker {
+        TaskGraph* Graph;
+        int Index;
+    };
+    TaskGraph(const TaskGraph&);
+    TaskGraph& operator=(const TaskGraph&);
+    static void* RunWorker(void* worker);
+    void Push(int worker, int task);
+    int PopOrSteal(int worker);
+    void Run(int worker, int task);
+    double GetElapsedSeconds() const;
+    std::vector<Task> m_tasks;
+    std::vector<WorkerQueue*> m_queues;
+    std::vector<Worker> m_workers;
+    std::vector<pthread_t> m_threads;
+    pthread_mutex_t m_mutex; // Guards m_ready and m_remaining changes, for m_condition
+    pthread_cond_t m_condition;
+    int m_ready; // Tasks sitting in queues
+    volatile int m_remaining; // Tasks not finished
+    bool m_started;
+    double m_startTime;
+};
+
+#endif
@@ -0,0 +1,101 @@
+//
+//  ThreadPool.cpp
+//  ModelViewer
+//
+
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(int maxThreads) :
+m_task(0),
+m_context(0),
+m_count(0),
+m_next(0),
+m_run(0),
+m_working(0),
+m_stopping(false)
+{
+    pthread_mutex_init(&m_mutex, 0);
+    pthread_cond_init(&m_started, 0);
+    pthread_cond_init(&m_finished, 0);
+    int threadCount = maxThreads > 0 ? maxThreads : GetCoreCount();
+    m_threads.reserve(threadCount - 1);
+    for (int i = 1; i < threadCount; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, RunWorker, this) == 0)
+            m_threads.push_back(thread);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_stopping = true;
+    pthread_cond_broadcast(&m_started);
+    pthread_mutex_unlock(&m_mutex);
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        pthread_join(m_threads[i], 0);
+    pthread_cond_destroy(&m_finished);
+    pthread_cond_destroy(&m_started);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+void ThreadPool::Run(int count, ParallelTask task, void* context)
+{
+    if (count <= 0)
+        return;
+    
+    // Waking the workers isn't worth it for a single index
+    if (m_threads.empty() || count == 1) {
+        for (int i = 0; i < count; ++i)
+            task(context, i);
+        return;
+    }
+    
+    pthread_mutex_lock(&m_mutex);
+    m_task = task;
+    m_context = context;
+    m_count = count;
+    m_next = 0;
+    m_working = m_threads.size();
+    ++m_run;
+    pthread_cond_broadcast(&m_started);
+    pthread_mutex_unlock(&m_mutex);
+    
+    Work();
+    
+    // The workers must have left this run before the next one resets m_next
+    pthread_mutex_lock(&m_mutex);
+    while (m_working > 0)
+        pthread_cond_wait(&m_finished, &m_mutex);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void* ThreadPool::RunWorker(void* argument)
+{
+    ThreadPool* pool = (ThreadPool*) argument;
+    unsigned int lastRun = 0;
+    pthread_mutex_lock(&pool->m_mutex);
+    for (;;) {
+        while (pool->m_run == lastRun && !pool->m_stopping)
+            pthread_cond_wait(&pool->m_started, &pool->m_mutex);
+        if (pool->m_stopping)
+            break;
+        lastRun = pool->m_run;
+        pthread_mutex_unlock(&pool->m_mutex);
+    
+        pool->Work();
+    
+        pthread_mutex_lock(&pool->m_mutex);
+        if (--pool->m_working == 0)
+            pthread_cond_signal(&pool->m_finished);
+    }
+    pthread_mutex_unlock(&pool->m_mutex);
+    return 0;
+}
+
+void ThreadPool::Work()
+{
+    int index;
+    while ((index = __sync_fetch_and_add(&m_next, 1)) < m_count)
+        m_task(m_context, index);
+}
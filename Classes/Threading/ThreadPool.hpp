@@ -0,0 +1,51 @@
+//
+//  ThreadPool.hpp
+//  ModelViewer
+//
+
+#ifndef ModelViewer_ThreadPool_h
+#define ModelViewer_ThreadPool_h
+
+#include "Parallel.hpp"
+#include <pthread.h>
+#include <vector>
+
+// Worker threads started once and kept for many ParallelFor-like runs, so
+// code that fans out several times a frame doesn't create and join threads
+// every time. Between runs the workers sleep on a condition variable.
+// One thread at a time may call Run.
+class ThreadPool {
+public:
+    // Starts one worker fewer than maxThreads (0 means one per core), the
+    // thread calling Run being the last.
+    explicit ThreadPool(int maxThreads = 0);
+    // Stops and joins the workers.
+    ~ThreadPool();
+    int GetThreadCount() const { return m_threads.size() + 1; }
+    // Calls task(context, i) for every i in [0, count) on the workers and the
+    // calling thread, and returns once every index is done. Doesn't allocate.
+    void Run(int count, ParallelTask task, void* context);
+    template <typename Task>
+    void Run(int count, Task& task)
+    {
+        Run(count, &InvokeParallelTask<Task>, &task);
+    }
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+    static void* RunWorker(void* pool);
+    void Work();
+    std::vector<pthread_t> m_threads;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_started; // Signalled when a run starts, or the pool stops
+    pthread_cond_t m_finished; // Signalled when the last worker leaves a run
+    ParallelTask m_task;
+    void* m_context;
+    int m_count;
+    volatile int m_next; // Next index to claim
+    unsigned int m_run; // Counts runs, so a worker knows a new one from the last
+    int m_working; // Workers not yet done with the current run
+    bool m_stopping;
+};
+
+#endif
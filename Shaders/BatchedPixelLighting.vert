@@ -0,0 +1,21 @@
+const char* BatchedVertexShader = STRINGIFY(
+
+attribute vec4 Position;
+attribute vec3 Normal;
+uniform mat4 Projection;
+uniform mat4 InstanceModelview[16]; // UniformBatchSize instances at a time
+uniform vec4 InstanceDiffuse[16];
+uniform float InstanceIndex;
+varying vec3 EyespaceNormal;
+varying vec3 Diffuse;
+
+void main(void)
+{
+    int instance = int(InstanceIndex);
+    mat4 modelview = InstanceModelview[instance];
+    mat3 normalMatrix = mat3(modelview[0].xyz, modelview[1].xyz, modelview[2].xyz);
+    EyespaceNormal = normalMatrix * Normal;
+    Diffuse = InstanceDiffuse[instance].rgb;
+    gl_Position = Projection * modelview * Position;
+}
+);
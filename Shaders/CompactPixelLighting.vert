@@ -0,0 +1,30 @@
+const char* CompactVertexShader = STRINGIFY(
+
+attribute vec4 Position;
+attribute vec2 Normal;
+attribute vec3 DiffuseMaterial;
+uniform mat4 Projection;
+uniform mat4 Modelview;
+uniform mat3 NormalMatrix;
+varying vec3 EyespaceNormal;
+varying vec3 Diffuse;
+
+// Normal is octahedral-encoded, scaled to +-32767
+vec3 DecodeNormal(vec2 encoded)
+{
+    vec2 e = encoded / 32767.0;
+    vec3 normal = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    if (normal.z < 0.0) {
+        vec2 signs = vec2(e.x < 0.0 ? -1.0 : 1.0, e.y < 0.0 ? -1.0 : 1.0);
+        normal.xy = (vec2(1.0) - abs(e.yx)) * signs;
+    }
+    return normalize(normal);
+}
+
+void main(void)
+{
+    EyespaceNormal = NormalMatrix * DecodeNormal(Normal);
+    Diffuse = DiffuseMaterial;
+    gl_Position = Projection * Modelview * Position;
+}
+);
@@ -0,0 +1,19 @@
+const char* InstancedVertexShader = STRINGIFY(
+
+attribute vec4 Position;
+attribute vec3 Normal;
+attribute mat4 InstanceModelview;
+attribute vec4 InstanceDiffuse;
+uniform mat4 Projection;
+varying vec3 EyespaceNormal;
+varying vec3 Diffuse;
+
+void main(void)
+{
+    // The modelview only rotates and translates, so its upper 3x3 is the normal matrix
+    mat3 normalMatrix = mat3(InstanceModelview[0].xyz, InstanceModelview[1].xyz, InstanceModelview[2].xyz);
+    EyespaceNormal = normalMatrix * Normal;
+    Diffuse = InstanceDiffuse.rgb;
+    gl_Position = Projection * InstanceModelview * Position;
+}
+);